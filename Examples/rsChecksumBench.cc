@@ -0,0 +1,196 @@
+/* Copyright (c) 2015 Diego Ongaro
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * \file
+ * Microbenchmark for the checksum algorithms in Core::Checksum, which
+ * SegmentedLog applies to every record it writes and reads (see the
+ * 'storageChecksum' config option).
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <getopt.h>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Core/Checksum.h"
+#include "Core/StringUtil.h"
+
+namespace {
+
+using namespace LogCabin;
+
+/**
+ * Parses argv for the main function.
+ */
+class OptionParser {
+  public:
+    OptionParser(int& argc, char**& argv)
+        : argc(argc)
+        , argv(argv)
+        , algorithms({"CRC32", "CRC32C", "Adler32", "SHA-1"})
+        , recordSizes({64, 1024, 8192, 1024 * 1024})
+        , totalBytes(256 * 1024 * 1024)
+    {
+        while (true) {
+            static struct option longOptions[] = {
+               {"algorithms",  required_argument, NULL, 'a'},
+               {"bytes",  required_argument, NULL, 'b'},
+               {"help",  no_argument, NULL, 'h'},
+               {"sizes",  required_argument, NULL, 's'},
+               {0, 0, 0, 0}
+            };
+            int c = getopt_long(argc, argv, "a:b:hs:", longOptions, NULL);
+
+            // Detect the end of the options.
+            if (c == -1)
+                break;
+
+            switch (c) {
+                case 'a':
+                    algorithms = Core::StringUtil::split(optarg, ',');
+                    break;
+                case 'b':
+                    totalBytes = strtoul(optarg, NULL, 10);
+                    break;
+                case 'h':
+                    usage();
+                    exit(0);
+                case 's': {
+                    recordSizes.clear();
+                    std::vector<std::string> sizes =
+                        Core::StringUtil::split(optarg, ',');
+                    for (auto it = sizes.begin(); it != sizes.end(); ++it)
+                        recordSizes.push_back(strtoul(it->c_str(), NULL, 10));
+                    break;
+                }
+                case '?':
+                default:
+                    // getopt_long already printed an error message.
+                    usage();
+                    exit(1);
+            }
+        }
+        if (optind < argc) {
+            std::cerr << "Too many arguments" << std::endl;
+            usage();
+            exit(1);
+        }
+    }
+
+    void usage() {
+        std::cout << "Measure the throughput of checksum algorithms over "
+                  << "records of various sizes."
+                  << std::endl
+                  << std::endl;
+        std::cout << "Usage: " << argv[0] << " [options]"
+                  << std::endl
+                  << std::endl;
+        std::cout << "Options:" << std::endl;
+        std::cout
+            << "  -a <names>, --algorithms=<names>  "
+            << "Comma-separated algorithms to measure"
+            << std::endl
+            << "                                    "
+            << "[default: CRC32,CRC32C,Adler32,SHA-1]"
+            << std::endl
+            << "  -b <bytes>, --bytes=<bytes>       "
+            << "Bytes to checksum per measurement"
+            << std::endl
+            << "                                    "
+            << "[default: 268435456]"
+            << std::endl
+            << "  -h, --help                        "
+            << "Print this usage information"
+            << std::endl
+            << "  -s <sizes>, --sizes=<sizes>       "
+            << "Comma-separated record sizes in bytes"
+            << std::endl
+            << "                                    "
+            << "[default: 64,1024,8192,1048576]"
+            << std::endl;
+        std::cout << std::endl;
+        std::cout << "Available algorithms:";
+        std::vector<std::string> names = Core::Checksum::listAlgorithms();
+        for (auto it = names.begin(); it != names.end(); ++it)
+            std::cout << " " << *it;
+        std::cout << std::endl;
+    }
+
+    int& argc;
+    char**& argv;
+    std::vector<std::string> algorithms;
+    std::vector<uint64_t> recordSizes;
+    uint64_t totalBytes;
+};
+
+} // anonymous namespace
+
+int
+main(int argc, char** argv)
+{
+    OptionParser options(argc, argv);
+
+    uint64_t maxSize = 0;
+    for (auto it = options.recordSizes.begin();
+         it != options.recordSizes.end();
+         ++it) {
+        maxSize = std::max(maxSize, *it);
+    }
+    std::vector<char> data(maxSize);
+    for (uint64_t i = 0; i < maxSize; ++i)
+        data.at(i) = char(rand());
+
+    std::cout << std::left << std::setw(12) << "algorithm"
+              << std::right << std::setw(12) << "record"
+              << std::setw(12) << "ns/record"
+              << std::setw(12) << "MB/s"
+              << std::endl;
+    for (auto algo = options.algorithms.begin();
+         algo != options.algorithms.end();
+         ++algo) {
+        for (auto size = options.recordSizes.begin();
+             size != options.recordSizes.end();
+             ++size) {
+            uint64_t iterations =
+                std::max(options.totalBytes / std::max(*size, 1UL), 1UL);
+            char output[Core::Checksum::MAX_LENGTH];
+            // Warm up (and fail early on unknown algorithms).
+            Core::Checksum::calculate(algo->c_str(),
+                                      data.data(), *size, output);
+            auto start = std::chrono::steady_clock::now();
+            for (uint64_t i = 0; i < iterations; ++i) {
+                Core::Checksum::calculate(algo->c_str(),
+                                          data.data(), *size, output);
+            }
+            auto end = std::chrono::steady_clock::now();
+            double nanos = double(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    end - start).count());
+            double mbps = (double(*size) * double(iterations) /
+                           (1024.0 * 1024.0)) / (nanos / 1e9);
+            std::cout << std::left << std::setw(12) << *algo
+                      << std::right << std::setw(12) << *size
+                      << std::setw(12) << std::fixed << std::setprecision(1)
+                      << nanos / double(iterations)
+                      << std::setw(12) << mbps
+                      << std::endl;
+        }
+    }
+    return 0;
+}
@@ -62,6 +62,29 @@ Result RaftStoreClient::raft_set(const std::string& key, const std::string& val)
     return result;
 }
 
+Result RaftStoreClient::raft_cas(const std::string& key, const std::string& expected_val,
+                                 const std::string& val) {
+
+    if (key.empty() || val.empty() || !cluster_) {
+        tzhttpd::tzhttpd_log_err("param error");
+        return Status::INVALID_ARGUMENT;
+    }
+
+    auto store = cluster_->getStore();
+    store.setCondition(key, expected_val);
+    auto result = store.write(key, val);
+    if(result.status != Status::OK) {
+        tzhttpd::tzhttpd_log_err("cas(%s:%s->%s) error with: %d(%s)",
+                                 key.c_str(), expected_val.c_str(), val.c_str(),
+                                 result.status, result.error.c_str());
+        return result;
+    }
+
+    tzhttpd::tzhttpd_log_debug("cas(%s:%s->%s) ok!", key.c_str(),
+                               expected_val.c_str(), val.c_str());
+    return result;
+}
+
 Result RaftStoreClient::raft_get(const std::string& key, std::string& val) {
 
     if (key.empty() || !cluster_) {
@@ -82,6 +105,26 @@ Result RaftStoreClient::raft_get(const std::string& key, std::string& val) {
     return result;
 }
 
+Result RaftStoreClient::raft_multi_get(const std::vector<std::string>& keys,
+                                       std::vector<Result>& results, std::vector<std::string>& vals) {
+    if (keys.empty() || !cluster_) {
+        tzhttpd::tzhttpd_log_err("param error");
+        return Status::INVALID_ARGUMENT;
+    }
+
+    auto store = cluster_->getStore();
+    auto result = store.multiRead(keys, results, vals);
+    if(result.status != Status::OK) {
+        tzhttpd::tzhttpd_log_err("multiRead(%lu keys) error with: %d(%s)",
+                                 keys.size(),
+                                 result.status, result.error.c_str());
+        return result;
+    }
+
+    tzhttpd::tzhttpd_log_debug("multiRead(%lu keys) ok!", keys.size());
+    return result;
+}
+
 Result RaftStoreClient::raft_remove(const std::string& key) {
     if (key.empty() || !cluster_) {
         tzhttpd::tzhttpd_log_err("param error");
@@ -101,6 +144,25 @@ Result RaftStoreClient::raft_remove(const std::string& key) {
     return result;
 }
 
+Result RaftStoreClient::raft_batch(const std::vector<BatchOperation>& ops) {
+    if (ops.empty() || !cluster_) {
+        tzhttpd::tzhttpd_log_err("param error");
+        return Status::INVALID_ARGUMENT;
+    }
+
+    auto store = cluster_->getStore();
+    auto result = store.batch(ops);
+    if(result.status != Status::OK) {
+        tzhttpd::tzhttpd_log_err("batch(%lu ops) error with: %d(%s)",
+                                 ops.size(),
+                                 result.status, result.error.c_str());
+        return result;
+    }
+
+    tzhttpd::tzhttpd_log_debug("batch(%lu ops) ok!", ops.size());
+    return result;
+}
+
 
 Result RaftStoreClient::raft_range(const std::string& start_key, const std::string& end_key, uint64_t limit,
                                    std::vector<std::string>& range_store) {
@@ -124,6 +186,31 @@ Result RaftStoreClient::raft_range(const std::string& start_key, const std::stri
     return result;
 }
 
+Result RaftStoreClient::raft_range(const std::string& start_key, const std::string& end_key, uint64_t limit,
+                                   bool reverse, const std::string& cursor,
+                                   std::vector<std::string>& range_store,
+                                   std::vector<std::string>& values, std::string& next_cursor) {
+
+    if (!cluster_) {
+        tzhttpd::tzhttpd_log_err("param error");
+        return Status::INVALID_ARGUMENT;
+    }
+
+    auto store = cluster_->getStore();
+    auto result = store.range(start_key, end_key, limit, reverse, true, cursor,
+                              range_store, values, next_cursor);
+    if(result.status != Status::OK) {
+        tzhttpd::tzhttpd_log_err("range(%s:%s) error with: %d(%s)",
+                                 start_key.c_str(), end_key.c_str(),
+                                 result.status, result.error.c_str());
+        return result;
+    }
+
+    tzhttpd::tzhttpd_log_debug("range(%s:%s) ok, %lu keys!", start_key.c_str(),
+                               end_key.c_str(), range_store.size());
+    return result;
+}
+
 Result RaftStoreClient::raft_search(const std::string& search_key, uint64_t limit,
                                     std::vector<std::string>& search_store) {
 
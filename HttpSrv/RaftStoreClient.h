@@ -27,11 +27,22 @@ public:
     Result raft_stat(const std::string& client, std::string& stat);
 
     Result raft_set(const std::string& key, const std::string& val);
+    // set key to val only if it currently holds expected_val (or, if
+    // expected_val is empty, only if it does not exist)
+    Result raft_cas(const std::string& key, const std::string& expected_val,
+                    const std::string& val);
     Result raft_get(const std::string& key, std::string& val);
+    Result raft_multi_get(const std::vector<std::string>& keys,
+                          std::vector<Result>& results, std::vector<std::string>& vals);
     Result raft_remove(const std::string& key);
+    Result raft_batch(const std::vector<BatchOperation>& ops);
 
     Result raft_range(const std::string& start_key, const std::string& end_key, uint64_t limit,
                       std::vector<std::string>& range_store);
+    Result raft_range(const std::string& start_key, const std::string& end_key, uint64_t limit,
+                      bool reverse, const std::string& cursor,
+                      std::vector<std::string>& range_store,
+                      std::vector<std::string>& values, std::string& next_cursor);
     Result raft_search(const std::string& search_key, uint64_t limit,
                        std::vector<std::string>& search_store);
 
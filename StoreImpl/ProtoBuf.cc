@@ -23,6 +23,31 @@ namespace ProtoBuf {
 
 namespace PC = LogCabin::Protocol::Client;
 
+namespace {
+
+/**
+ * Convert a Store status into the status code sent to clients.
+ */
+PC::Status
+toProtocolStatus(Status status)
+{
+    switch (status) {
+        case Status::OK:
+            return PC::Status::OK;
+        case Status::INVALID_ARGUMENT:
+            return PC::Status::INVALID_ARGUMENT;
+        case Status::OPERATION_ERROR:
+            return PC::Status::LOOKUP_ERROR;
+        case Status::CONDITION_NOT_MET:
+            return PC::Status::CONDITION_NOT_MET;
+        case Status::UNKNOWN_ERROR:
+            break;
+    }
+    return PC::Status::UNKNOWN;
+}
+
+} // anonymous namespace
+
 void
 readOnlyStoreRPC(const Store& store,
                  const PC::ReadOnlyStore::Request& request,
@@ -30,7 +55,7 @@ readOnlyStoreRPC(const Store& store,
 {
     Result result;
 
-    result = store.checkCondition(request.read().path());
+    result = store.checkReserved(request.read().path());
     if (result.status != Status::OK) {
 
     } else if (request.has_stat()) {
@@ -48,13 +73,26 @@ readOnlyStoreRPC(const Store& store,
     } else if (request.has_range()) {
 
         std::vector<std::string> range_store;
+        std::vector<std::string> values;
+        std::string next_cursor;
         std::string start_key = request.range().start_key();
         std::string end_key = request.range().end_key();
         uint64_t limit = request.range().limit();
-        result = store.range(start_key, end_key, limit, range_store);
+        result = store.range(start_key, end_key, limit,
+                             request.range().reverse(),
+                             request.range().cursor(),
+                             range_store,
+                             request.range().include_values() ? &values : NULL,
+                             next_cursor);
 
         *response.mutable_range()->mutable_contents()
                 = {range_store.begin(), range_store.end()};
+        if (request.range().include_values()) {
+            *response.mutable_range()->mutable_values()
+                    = {values.begin(), values.end()};
+        }
+        if (!next_cursor.empty())
+            response.mutable_range()->set_next_cursor(next_cursor);
 
     } else if (request.has_search()) {
 
@@ -66,12 +104,33 @@ readOnlyStoreRPC(const Store& store,
         *response.mutable_search()->mutable_contents()
                 = {search_store.begin(), search_store.end()};
 
+    } else if (request.has_multi_read()) {
+
+        // The individual reads may fail independently; the request as a
+        // whole succeeds.
+        const PC::ReadOnlyStore::Request::MultiRead& multi_read =
+            request.multi_read();
+        PC::ReadOnlyStore::Response::MultiRead& items =
+            *response.mutable_multi_read();
+        for (int i = 0; i < multi_read.path_size(); ++i) {
+            PC::ReadOnlyStore::Response::MultiRead::Item& item =
+                *items.add_item();
+            std::string content;
+            Result itemResult = store.checkReserved(multi_read.path(i));
+            if (itemResult.status == Status::OK)
+                itemResult = store.read(multi_read.path(i), content);
+            item.set_status(toProtocolStatus(itemResult.status));
+            if (itemResult.status != Status::OK)
+                item.set_error(itemResult.error);
+            else
+                item.set_content(content);
+        }
 
     } else {
         PANIC("Unexpected request: %s",
               Core::ProtoBuf::dumpString(request).c_str());
     }
-    response.set_status(static_cast<PC::Status>(result.status));
+    response.set_status(toProtocolStatus(result.status));
     if (result.status != Status::OK)
         response.set_error(result.error);
 }
@@ -83,9 +142,16 @@ readWriteStoreRPC(Store& store,
 {
     Result result;
 
+    if (request.has_condition()) {
+        result = store.checkCondition(request.condition().path(),
+                                      request.condition().contents());
+        if (result.status != Status::OK)
+            goto ret;
+    }
+
     if (request.has_write()) {
 
-        result = store.checkCondition(request.write().path());
+        result = store.checkReserved(request.write().path());
         if (result.status != Status::OK)
             goto ret;
         result = store.write(request.write().path(),
@@ -93,18 +159,37 @@ readWriteStoreRPC(Store& store,
 
     } else if (request.has_remove()) {
 
-        result = store.checkCondition(request.remove().path());
+        result = store.checkReserved(request.remove().path());
         if (result.status != Status::OK)
             goto ret;
         result = store.remove(request.remove().path());
 
+    } else if (request.has_batch()) {
+
+        const PC::ReadWriteStore::Request::Batch& batch = request.batch();
+        std::vector<BatchOp> ops;
+        ops.reserve(batch.ops_size());
+        for (int i = 0; i < batch.ops_size(); ++i) {
+            const PC::ReadWriteStore::Request::Batch::Op& op = batch.ops(i);
+            if (op.has_write()) {
+                ops.push_back({op.write().path(), &op.write().content()});
+            } else if (op.has_remove()) {
+                ops.push_back({op.remove().path(), NULL});
+            } else {
+                result.status = Status::INVALID_ARGUMENT;
+                result.error = "Batch operation is neither write nor remove";
+                goto ret;
+            }
+        }
+        result = store.batchWrite(ops);
+
     } else {
         PANIC("Unexpected request: %s",
               Core::ProtoBuf::dumpString(request).c_str());
     }
 
 ret:
-    response.set_status(static_cast<PC::Status>(result.status));
+    response.set_status(toProtocolStatus(result.status));
     if (result.status != Status::OK)
         response.set_error(result.error);
 }
@@ -29,6 +29,62 @@ namespace Store {
 
 using Core::StringUtil::format;
 
+namespace {
+
+/**
+ * Keys starting with this prefix hold the store's own metadata. They are
+ * hidden from clients and excluded from snapshots. The leading NUL byte keeps
+ * them out of the way of any sensible client key.
+ */
+const std::string METADATA_PREFIX("\0meta/", 6);
+
+/**
+ * The key under which commitBatch() saves the caller's metadata.
+ */
+const std::string METADATA_KEY(METADATA_PREFIX + "state");
+
+/**
+ * Return true if the given key belongs to the store's reserved metadata.
+ */
+bool
+isMetadataKey(const leveldb::Slice& key)
+{
+    return key.starts_with(METADATA_PREFIX);
+}
+
+/**
+ * Version tag at the start of range cursors, so that their encoding can
+ * change later without misinterpreting old cursors.
+ */
+const char RANGE_CURSOR_VERSION = 1;
+
+/**
+ * Build the cursor returned by Store::range() for resuming at the given key.
+ */
+std::string
+encodeRangeCursor(const leveldb::Slice& key)
+{
+    std::string cursor(1, RANGE_CURSOR_VERSION);
+    cursor.append(key.data(), key.size());
+    return cursor;
+}
+
+/**
+ * Extract the key to resume at from a cursor built by encodeRangeCursor().
+ * \return
+ *      False if the cursor is malformed.
+ */
+bool
+decodeRangeCursor(const std::string& cursor, std::string& key)
+{
+    if (cursor.empty() || cursor[0] != RANGE_CURSOR_VERSION)
+        return false;
+    key = cursor.substr(1);
+    return true;
+}
+
+} // anonymous namespace
+
 ////////// enum Status //////////
 
 std::ostream&
@@ -65,103 +121,315 @@ Result::Result()
 
 ////////// class Tree //////////
 
-Store::Store(const std::string& levelDBPath)
+Store::Store(const std::string& levelDBPath, const Core::Config& config)
     : numWriteAttempted(0)
     , numWriteSuccess(0)
     , numReadAttempted(0)
     , numReadSuccess(0)
     , numRemoveAttempted(0)
     , numRemoveSuccess(0)
+    , numBatchAttempted(0)
+    , numBatchSuccess(0)
+    , numBatchOps(0)
+    , numConditionChecked(0)
+    , numConditionNotMet(0)
+    , numSearchIndexed(0)
+    , numSearchScanned(0)
+    , numSearchCandidates(0)
+    , numSearchMatches(0)
+    , searchIndexEnabled(config.read<bool>("storeSearchIndex", true))
+    , searchIndex()
+    , snapshotChunkBytes(
+            config.read<uint64_t>("snapshotChunkBytes", 1024 * 1024))
+    , restoreBatchBytes(
+            config.read<uint64_t>("snapshotRestoreBatchBytes",
+                                  4 * 1024 * 1024))
+    , restoreWriteBufferBytes(
+            config.read<uint64_t>("snapshotRestoreWriteBufferBytes",
+                                  64 * 1024 * 1024))
     , levelDBPath_(levelDBPath)
+    , levelDB_()
+    , batching(false)
+    , batch()
+    , staged()
 {
 }
 
 bool Store::init() {
 
+    openLevelDB();
+
+    searchIndex.clear();
+    if (searchIndexEnabled) {
+        leveldb::ReadOptions read_options;
+        read_options.fill_cache = false;
+        std::unique_ptr<leveldb::Iterator> it(levelDB_->NewIterator(read_options));
+        for (it->SeekToFirst(); it->Valid(); it->Next()) {
+            if (!isMetadataKey(it->key()))
+                searchIndex.insert(it->key().ToString());
+        }
+        NOTICE("Built search index over %lu keys (%lu trigrams)",
+               searchIndex.getNumKeys(), searchIndex.getNumTrigrams());
+    }
+
+    return true;
+}
+
+void
+Store::openLevelDB()
+{
     leveldb::Options options;
     options.create_if_missing = true;
     leveldb::DB* db;
     leveldb::Status status = leveldb::DB::Open(options, levelDBPath_, &db);
 
     if (!status.ok()) {
-        PANIC("Open levelDB %s failed.", levelDBPath_.c_str());
-        return false;
+        PANIC("Open levelDB %s failed: %s",
+              levelDBPath_.c_str(), status.ToString().c_str());
     }
 
     levelDB_.reset(db);
+}
 
-    return true;
+
+Store::ReadView::ReadView(leveldb::DB* db)
+    : db(db)
+    , snapshot(db->GetSnapshot())
+{
 }
 
+Store::ReadView::~ReadView()
+{
+    db->ReleaseSnapshot(snapshot);
+}
 
-void
-Store::dumpSnapshot(Core::ProtoBuf::OutputStream& stream) const
+std::unique_ptr<Store::ReadView>
+Store::getReadView() const
 {
-    Snapshot::SnapshotItem total;
-    Snapshot::KeyValue* ptr;
+    return std::unique_ptr<ReadView>(new ReadView(levelDB_.get()));
+}
 
-    std::unique_ptr<leveldb::Iterator> it(levelDB_->NewIterator(leveldb::ReadOptions()));
+bool
+Store::dumpSnapshot(Core::ProtoBuf::OutputStream& stream,
+                    const ReadView* view,
+                    const std::atomic<bool>* abort) const
+{
+    Snapshot::Chunk chunk;
+    uint64_t chunkBytes = 0;
+    uint64_t numChunks = 0;
+
+    leveldb::ReadOptions read_options;
+    // A full scan would otherwise push the hot working set out of the cache.
+    read_options.fill_cache = false;
+    if (view != NULL) {
+        assert(view->db == levelDB_.get());
+        read_options.snapshot = view->snapshot;
+    }
+    std::unique_ptr<leveldb::Iterator> it(levelDB_->NewIterator(read_options));
     uint64_t cnt = 0;
 
     for (it->SeekToFirst(); it->Valid(); it->Next()) {
 
         leveldb::Slice key = it->key();
-        std::string key_str = key.ToString();
-
         leveldb::Slice value = it->value();
-        std::string val_str = value.ToString();
+        if (isMetadataKey(key))
+            continue;
 
-        ptr = total.add_kv();
-        ptr->set_key(key_str);
-        ptr->set_value(val_str);
+        Snapshot::KeyValue* ptr = chunk.add_kv();
+        ptr->set_key(key.data(), key.size());
+        ptr->set_value(value.data(), value.size());
+        chunkBytes += key.size() + value.size();
 
         ++ cnt;
 
+        if (chunkBytes >= snapshotChunkBytes) {
+            stream.writeMessage(chunk);
+            chunk.Clear();
+            chunkBytes = 0;
+            ++ numChunks;
+            if (abort != NULL && *abort) {
+                NOTICE("dumpSnapshot aborted after %lu items in %lu chunks.",
+                       cnt, numChunks);
+                return false;
+            }
+        }
     }
-    stream.writeMessage(total);
-    NOTICE("dumpSnapshot finished, snapshot totally store %lu items.", cnt);
+    if (!it->status().ok()) {
+        PANIC("Iterating levelDB for snapshot failed: %s",
+              it->status().ToString().c_str());
+    }
+
+    // The final chunk holds whatever is left over, possibly nothing.
+    chunk.set_last(true);
+    stream.writeMessage(chunk);
+    ++ numChunks;
+    NOTICE("dumpSnapshot finished, snapshot totally store %lu items "
+           "in %lu chunks.", cnt, numChunks);
+    return true;
 }
 
 
-void
-Store::loadSnapshot(Core::ProtoBuf::InputStream& stream)
+uint64_t
+Store::loadSnapshot(Core::ProtoBuf::InputStream& stream,
+                    uint8_t formatVersion)
 {
 
     // destroy levelDB completely first
+    levelDB_.reset();
     leveldb::DestroyDB(levelDBPath_, leveldb::Options());
+    searchIndex.clear();
 
+    // Bulk-load settings: a large memtable so that the sorted input is
+    // flushed in few, large tables. Writes are not synced; the compaction at
+    // the end flushes everything to disk.
     leveldb::Options create_options;
+    create_options.create_if_missing = true;
     create_options.error_if_exists = true;
+    create_options.write_buffer_size = restoreWriteBufferBytes;
     leveldb::DB* db;
     leveldb::Status status = leveldb::DB::Open(create_options, levelDBPath_, &db);
 
     if (!status.ok()) {
-        ERROR("Reset levelDB error: %s", levelDBPath_.c_str());
-        return;
+        PANIC("Reset levelDB %s error: %s",
+              levelDBPath_.c_str(), status.ToString().c_str());
     }
     levelDB_.reset(db);
 
-    // load data
-    Snapshot::SnapshotItem total;
-    stream.readMessage(total);
+    leveldb::WriteBatch batch;
+    uint64_t batchBytes = 0;
+    uint64_t cnt = 0;
 
-    leveldb::WriteOptions write_options;
-    int size = total.kv_size();
-    for (int i = 0; i < size; ++ i) {
-        Snapshot::KeyValue kv = total.kv(i);
-        leveldb::Status status = levelDB_->Put(write_options, kv.key(), kv.value());
-        if (!status.ok()) {
-            ERROR("Restoring %s:%s failed, give up...",
-                            kv.key().c_str(), kv.value().c_str());
-            return;
+    if (formatVersion == 1) {
+        // legacy format: everything in one message
+        Snapshot::SnapshotItem total;
+        std::string error = stream.readMessage(total);
+        if (!error.empty()) {
+            PANIC("Couldn't read store from snapshot: %s", error.c_str());
         }
+        for (int i = 0; i < total.kv_size(); ++ i) {
+            const Snapshot::KeyValue& kv = total.kv(i);
+            batch.Put(kv.key(), kv.value());
+            if (searchIndexEnabled)
+                searchIndex.insert(kv.key());
+            batchBytes += kv.key().size() + kv.value().size();
+            ++ cnt;
+            if (batchBytes >= restoreBatchBytes) {
+                writeRestoreBatch(batch);
+                batchBytes = 0;
+            }
+        }
+    } else {
+        Snapshot::Chunk chunk;
+        do {
+            chunk.Clear();
+            std::string error = stream.readMessage(chunk);
+            if (!error.empty()) {
+                PANIC("Couldn't read store chunk from snapshot (after %lu "
+                      "items): %s", cnt, error.c_str());
+            }
+            for (int i = 0; i < chunk.kv_size(); ++ i) {
+                const Snapshot::KeyValue& kv = chunk.kv(i);
+                batch.Put(kv.key(), kv.value());
+                if (searchIndexEnabled)
+                    searchIndex.insert(kv.key());
+                batchBytes += kv.key().size() + kv.value().size();
+                ++ cnt;
+            }
+            if (batchBytes >= restoreBatchBytes) {
+                writeRestoreBatch(batch);
+                batchBytes = 0;
+            }
+        } while (!chunk.last());
+    }
+    writeRestoreBatch(batch);
+
+    // Flush the memtable and settle the tables into their final levels in
+    // one go, then reopen with the normal settings.
+    levelDB_->CompactRange(NULL, NULL);
+    levelDB_.reset();
+    openLevelDB();
+
+    NOTICE("loadSnapshot finished, restored %lu items.", cnt);
+    return cnt;
+}
+
+void
+Store::writeRestoreBatch(leveldb::WriteBatch& batch)
+{
+    leveldb::WriteOptions write_options;
+    write_options.sync = false;
+    leveldb::Status status = levelDB_->Write(write_options, &batch);
+    if (!status.ok()) {
+        PANIC("Restoring snapshot into levelDB %s failed: %s",
+              levelDBPath_.c_str(), status.ToString().c_str());
+    }
+    batch.Clear();
+}
+
+
+void
+Store::beginBatch()
+{
+    assert(!batching);
+    batching = true;
+    batch.Clear();
+    staged.clear();
+}
+
+void
+Store::commitBatch(const google::protobuf::Message& metadata, bool sync)
+{
+    assert(batching);
+    Core::Buffer buf;
+    Core::ProtoBuf::serialize(metadata, buf);
+    batch.Put(METADATA_KEY,
+              leveldb::Slice(static_cast<const char*>(buf.getData()),
+                             buf.getLength()));
+
+    leveldb::WriteOptions options;
+    options.sync = sync;
+    leveldb::Status status = levelDB_->Write(options, &batch);
+    if (!status.ok()) {
+        // The state machine can't make progress without its writes.
+        PANIC("Committing batch to levelDB %s failed: %s",
+              levelDBPath_.c_str(), status.ToString().c_str());
     }
+    batch.Clear();
+    staged.clear();
+    batching = false;
+}
+
+void
+Store::abortBatch()
+{
+    batch.Clear();
+    staged.clear();
+    batching = false;
+}
+
+bool
+Store::readMetadata(google::protobuf::Message& metadata) const
+{
+    std::string value;
+    leveldb::Status status =
+        levelDB_->Get(leveldb::ReadOptions(), METADATA_KEY, &value);
+    if (status.IsNotFound())
+        return false;
+    if (!status.ok()) {
+        PANIC("Reading metadata from levelDB %s failed: %s",
+              levelDBPath_.c_str(), status.ToString().c_str());
+    }
+    Core::Buffer buf(const_cast<char*>(value.data()), value.length(), NULL);
+    if (!Core::ProtoBuf::parse(buf, metadata)) {
+        PANIC("Could not parse metadata in levelDB %s",
+              levelDBPath_.c_str());
+    }
+    return true;
 }
 
 
 Result
-Store::checkCondition(const std::string& key,
-                      const std::string& content) const
+Store::checkReserved(const std::string& key) const
 {
     Result result;
 
@@ -171,9 +439,64 @@ Store::checkCondition(const std::string& key,
         return result;
     }
 
+    if (isMetadataKey(key)) {
+        result.status = Status::CONDITION_NOT_MET;
+        result.error = "reserved metadata path";
+        return result;
+    }
+
+    return result;
+}
+
+Result
+Store::checkCondition(const std::string& key,
+                      const std::string& content) const
+{
+    Result result = checkReserved(key);
+    if (result.status != Status::OK)
+        return result;
+
+    ++numConditionChecked;
+    std::string current;
+    bool exists = lookup(key, current);
+    if (content.empty()) {
+        if (exists) {
+            result.status = Status::CONDITION_NOT_MET;
+            result.error = format("Path '%s' exists, but condition expected "
+                                  "it not to", key.c_str());
+        }
+    } else if (!exists) {
+        result.status = Status::CONDITION_NOT_MET;
+        result.error = format("Could not read value at path '%s'",
+                              key.c_str());
+    } else if (current != content) {
+        result.status = Status::CONDITION_NOT_MET;
+        result.error = format("Path '%s' has value '%s', not '%s' as "
+                              "required", key.c_str(), current.c_str(),
+                              content.c_str());
+    }
+    if (result.status != Status::OK)
+        ++numConditionNotMet;
     return result;
 }
 
+bool
+Store::lookup(const std::string& key, std::string& content) const
+{
+    content.clear();
+    if (batching) {
+        auto it = staged.find(key);
+        if (it != staged.end()) {
+            if (!it->second)
+                return false;
+            content = *it->second;
+            return true;
+        }
+    }
+    leveldb::Status status = levelDB_->Get(leveldb::ReadOptions(), key, &content);
+    return status.ok();
+}
+
 
 
 Result
@@ -189,6 +512,15 @@ Store::write(const std::string& key, const std::string& content)
     }
 
 
+    if (batching) {
+        batch.Put(key, content);
+        staged[key].reset(new std::string(content));
+        if (searchIndexEnabled)
+            searchIndex.insert(key);
+        ++numWriteSuccess;
+        return result;
+    }
+
     leveldb::WriteOptions options;
     options.sync = true;
     leveldb::Status status = levelDB_->Put(options, key, content);
@@ -198,6 +530,8 @@ Store::write(const std::string& key, const std::string& content)
         return result;
     }
 
+    if (searchIndexEnabled)
+        searchIndex.insert(key);
     ++numWriteSuccess;
     return result;
 }
@@ -215,8 +549,7 @@ Store::read(const std::string& key, std::string& content) const
         return result;
     }
 
-    leveldb::Status status = levelDB_->Get(leveldb::ReadOptions(), key, &content);
-    if (!status.ok()) {
+    if (!lookup(key, content)) {
         result.status = Status::OPERATION_ERROR;
         result.error = format("Operation failed: %s", key.c_str());
         return result;
@@ -238,6 +571,15 @@ Store::remove(const std::string& key)
         return result;
     }
 
+    if (batching) {
+        batch.Delete(key);
+        staged[key].reset();
+        if (searchIndexEnabled)
+            searchIndex.remove(key);
+        ++numRemoveSuccess;
+        return result;
+    }
+
     leveldb::WriteOptions options;
     options.sync = true;
     leveldb::Status status = levelDB_->Delete(options, key);
@@ -247,46 +589,160 @@ Store::remove(const std::string& key)
         return result;
     }
 
+    if (searchIndexEnabled)
+        searchIndex.remove(key);
     ++numRemoveSuccess;
     return result;
 }
 
+Result
+Store::batchWrite(const std::vector<BatchOp>& ops)
+{
+    ++numBatchAttempted;
+    Result result {};
+
+    // Check every operation up front so that a bad one leaves no trace.
+    for (auto it = ops.begin(); it != ops.end(); ++it) {
+        if (it->key.empty() ||
+            (it->content != NULL && it->content->empty())) {
+            result.status = Status::INVALID_ARGUMENT;
+            result.error = format("Invalid param in batch: %s",
+                                  it->key.c_str());
+            return result;
+        }
+        result = checkReserved(it->key);
+        if (result.status != Status::OK)
+            return result;
+    }
+
+    if (batching) {
+        // Staged into the caller's batch, which commits atomically.
+        for (auto it = ops.begin(); it != ops.end(); ++it) {
+            if (it->content != NULL)
+                write(it->key, *it->content);
+            else
+                remove(it->key);
+        }
+        numBatchOps += ops.size();
+        ++numBatchSuccess;
+        return result;
+    }
+
+    leveldb::WriteBatch writeBatch;
+    for (auto it = ops.begin(); it != ops.end(); ++it) {
+        if (it->content != NULL)
+            writeBatch.Put(it->key, *it->content);
+        else
+            writeBatch.Delete(it->key);
+    }
+
+    leveldb::WriteOptions options;
+    options.sync = true;
+    leveldb::Status status = levelDB_->Write(options, &writeBatch);
+    if (!status.ok()) {
+        result.status = Status::OPERATION_ERROR;
+        result.error = format("Operation failed: batch of %lu",
+                              ops.size());
+        return result;
+    }
+
+    for (auto it = ops.begin(); it != ops.end(); ++it) {
+        if (it->content != NULL) {
+            if (searchIndexEnabled)
+                searchIndex.insert(it->key);
+            ++numWriteAttempted;
+            ++numWriteSuccess;
+        } else {
+            if (searchIndexEnabled)
+                searchIndex.remove(it->key);
+            ++numRemoveAttempted;
+            ++numRemoveSuccess;
+        }
+    }
+    numBatchOps += ops.size();
+    ++numBatchSuccess;
+    return result;
+}
+
 
 
 Result
 Store::range(const std::string& start, const std::string& end, uint64_t limit,
              std::vector<std::string>& range_store) const {
+    std::string nextCursor;
+    return range(start, end, limit, false, "",
+                 range_store, NULL, nextCursor);
+}
+
+Result
+Store::range(const std::string& start, const std::string& end, uint64_t limit,
+             bool reverse, const std::string& cursor,
+             std::vector<std::string>& range_store,
+             std::vector<std::string>* values,
+             std::string& nextCursor) const {
 
     ++numReadAttempted;
     Result result {};
+    nextCursor.clear();
+
+    // Where iteration begins: the start of the range in its direction, moved
+    // up to the cursor if it lies further along.
+    std::string from = reverse ? end : start;
+    if (!cursor.empty()) {
+        std::string resume;
+        if (!decodeRangeCursor(cursor, resume)) {
+            result.status = Status::INVALID_ARGUMENT;
+            result.error = "Malformed range cursor";
+            return result;
+        }
+        if (from.empty() || (reverse ? resume < from : resume > from))
+            from = resume;
+    }
 
     std::unique_ptr<leveldb::Iterator> it(levelDB_->NewIterator(leveldb::ReadOptions()));
-    uint64_t cnt = 0;
-    leveldb::Options options;
+    const leveldb::Comparator* comparator = leveldb::BytewiseComparator();
 
-    if (start.empty()) {
-        it->SeekToFirst();
+    if (!reverse) {
+        if (from.empty())
+            it->SeekToFirst();
+        else
+            it->Seek(from);
     } else {
-        it->Seek(start);
+        // Seek() finds the first key >= from; step back unless it is equal.
+        if (from.empty()) {
+            it->SeekToLast();
+        } else {
+            it->Seek(from);
+            if (!it->Valid())
+                it->SeekToLast();
+            else if (comparator->Compare(it->key(), from) > 0)
+                it->Prev();
+        }
     }
 
-    for ( /* */; it->Valid(); it->Next()) {
+    for ( /* */; it->Valid(); reverse ? it->Prev() : it->Next()) {
 
         leveldb::Slice key = it->key();
-        std::string key_str = key.ToString();
-
-        // leveldb::Slice value = it->value();
-        // std::string val_str = value.ToString();
-
-        if (limit && ++cnt > limit) {
-            break;
+        if (isMetadataKey(key))
+            continue;
+
+        if (!reverse) {
+            if (!end.empty() && comparator->Compare(key, end) > 0)
+                break;
+        } else {
+            if (!start.empty() && comparator->Compare(key, start) < 0)
+                break;
         }
 
-        if (!end.empty() && options.comparator->Compare(key, end) > 0) {
+        // Another key remains in range: hand out a cursor pointing at it.
+        if (limit && range_store.size() >= limit) {
+            nextCursor = encodeRangeCursor(key);
             break;
         }
 
-        range_store.push_back(key_str);
+        range_store.push_back(key.ToString());
+        if (values != NULL)
+            values->push_back(it->value().ToString());
     }
 
     ++numReadSuccess;
@@ -300,25 +756,39 @@ Store::search(const std::string& search_key, uint64_t limit,
     ++numReadAttempted;
     Result result {};
 
+    if (searchIndexEnabled &&
+        search_key.length() >= TrigramIndex::MIN_PATTERN_LENGTH) {
+        ++numSearchIndexed;
+        std::vector<std::string> matches;
+        numSearchCandidates += searchIndex.search(search_key, matches);
+        numSearchMatches += matches.size();
+        if (limit && matches.size() > limit)
+            matches.resize(limit);
+        search_store.insert(search_store.end(),
+                            matches.begin(), matches.end());
+        ++numReadSuccess;
+        return result;
+    }
+
+    ++numSearchScanned;
     std::unique_ptr<leveldb::Iterator> it(levelDB_->NewIterator(leveldb::ReadOptions()));
     uint64_t cnt = 0;
-    leveldb::Options options;
 
     for (it->SeekToFirst(); it->Valid(); it->Next()) {
 
         leveldb::Slice key = it->key();
+        if (isMetadataKey(key))
+            continue;
         std::string key_str = key.ToString();
 
         // leveldb::Slice value = it->value();
         // std::string val_str = value.ToString();
 
         if (key_str.find(search_key) != std::string::npos) {
+            if (limit && ++cnt > limit)
+                break;
             search_store.push_back(key_str);
         }
-
-        if (limit && ++cnt > limit) {
-            break;
-        }
     }
 
     ++numReadSuccess;
@@ -350,6 +820,34 @@ Store::updateServerStats(Protocol::ServerStats::Store& tstats) const
         numRemoveAttempted);
     tstats.set_num_remove_success(
         numRemoveSuccess);
+    tstats.set_num_batch_attempted(
+        numBatchAttempted);
+    tstats.set_num_batch_success(
+        numBatchSuccess);
+    tstats.set_num_batch_ops(
+        numBatchOps);
+    tstats.set_num_condition_checked(
+        numConditionChecked);
+    tstats.set_num_condition_not_met(
+        numConditionNotMet);
+    tstats.set_search_index_enabled(
+        searchIndexEnabled);
+    tstats.set_search_index_keys(
+        searchIndex.getNumKeys());
+    tstats.set_search_index_trigrams(
+        searchIndex.getNumTrigrams());
+    tstats.set_search_index_postings(
+        searchIndex.getNumPostings());
+    tstats.set_search_index_bytes(
+        searchIndex.getApproximateBytes());
+    tstats.set_num_search_indexed(
+        numSearchIndexed);
+    tstats.set_num_search_scanned(
+        numSearchScanned);
+    tstats.set_num_search_candidates(
+        numSearchCandidates);
+    tstats.set_num_search_matches(
+        numSearchMatches);
 }
 
 } // namespace LogCabin::Store
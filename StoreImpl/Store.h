@@ -14,16 +14,21 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <atomic>
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <memory>
 
 #include <boost/noncopyable.hpp>
 
 #include <leveldb/db.h>
+#include <leveldb/write_batch.h>
 
+#include "Core/Config.h"
 #include "Core/ProtoBuf.h"
+#include "StoreImpl/TrigramIndex.h"
 
 #ifndef LOGCABIN_STOREIMPL_STORE_H
 #define LOGCABIN_STOREIMPL_STORE_H
@@ -61,8 +66,8 @@ enum class Status {
 
     /**
      * Precondition check, may read/write reserved path
-     * [[keepalive-reserved-path]]
-     *
+     * [[keepalive-reserved-path]], or the condition given with a
+     * read-write command did not hold (see checkCondition()).
      */
     CONDITION_NOT_MET = 3,
 
@@ -100,6 +105,20 @@ struct Result {
     std::string error;
 };
 
+/**
+ * One operation of an atomic Store::batchWrite().
+ */
+struct BatchOp {
+    /**
+     * The key to write or remove.
+     */
+    std::string key;
+    /**
+     * The new value to write, or NULL to remove the key.
+     */
+    const std::string* content;
+};
+
 /**
  * This is an in-memory, hierarchical key-value store.
  * TODO(ongaro): Document how this fits into the rest of the system.
@@ -108,25 +127,136 @@ class Store: public boost::noncopyable {
   public:
     /**
      * Constructor.
+     * \param levelDBPath
+     *      Directory of the levelDB database backing this store.
+     * \param config
+     *      Settings for the store (see snapshotChunkBytes).
+     */
+    Store(const std::string& levelDBPath, const Core::Config& config);
+
+    /**
+     * Open the levelDB database, creating it if needed, and build the search
+     * index from its keys.
      */
-    explicit Store(const std::string& levelDBPath);
     bool init();
 
     /**
-     * Write the levelDB store to the given stream.
+     * A consistent, read-only view of the store as of the time it was taken,
+     * backed by a leveldb::Snapshot. Writes made to the store afterwards are
+     * not visible through the view, so it may be dumped while the store keeps
+     * changing.
+     * \warning
+     *      The view must be destroyed before the store is reloaded by
+     *      loadSnapshot().
+     */
+    class ReadView : public boost::noncopyable {
+      public:
+        explicit ReadView(leveldb::DB* db);
+        ~ReadView();
+        /// The database this view reads from.
+        leveldb::DB* const db;
+        /// The underlying levelDB snapshot, released on destruction.
+        const leveldb::Snapshot* const snapshot;
+    };
+
+    /**
+     * Take a consistent read view of the current store contents. This is
+     * cheap: it only pins the current levelDB sequence number.
+     */
+    std::unique_ptr<ReadView> getReadView() const;
+
+    /**
+     * Write the levelDB store to the given stream, as a sequence of
+     * Snapshot::Chunk messages of at most #snapshotChunkBytes each. Only one
+     * chunk is held in memory at a time.
+     * \param stream
+     *      Where to write the store's contents.
+     * \param view
+     *      If given, dump the store as seen through this view rather than its
+     *      current contents.
+     * \param abort
+     *      If given, polled between chunks; once it becomes true, the dump
+     *      stops early and the stream is left incomplete.
+     * \return
+     *      True if the whole store was written, false if aborted.
      */
-    void dumpSnapshot(Core::ProtoBuf::OutputStream& stream) const;
+    bool dumpSnapshot(Core::ProtoBuf::OutputStream& stream,
+                      const ReadView* view = NULL,
+                      const std::atomic<bool>* abort = NULL) const;
 
     /**
      * Load the total levelDB from the given stream.
+     * \param stream
+     *      Stream positioned at the start of the store's contents.
+     * \param formatVersion
+     *      The state machine's snapshot format version: 1 for a single
+     *      Snapshot::SnapshotItem, 2 for a stream of Snapshot::Chunk.
+     * \return
+     *      The number of keys restored.
      * \warning
      *      Original levelDB store will remove completedly first.
+     *
+     * Keys are loaded in large unsynced leveldb::WriteBatch groups into a
+     * database opened with a large write buffer, followed by a single
+     * compaction at the end, which also makes the restored data durable.
      */
-    void loadSnapshot(Core::ProtoBuf::InputStream& stream);
+    uint64_t loadSnapshot(Core::ProtoBuf::InputStream& stream,
+                          uint8_t formatVersion);
+
+    /**
+     * Start staging write() and remove() calls into a batch instead of
+     * applying them to levelDB immediately. The batch is applied atomically
+     * by commitBatch(). read() sees the writes staged so far, so a batch
+     * may span many commands that depend on each other.
+     * \warning
+     *      range() and search() do not see writes staged in the current
+     *      batch.
+     */
+    void beginBatch();
+
+    /**
+     * Atomically apply the writes staged since beginBatch(), along with the
+     * given metadata, in a single levelDB write.
+     * \param metadata
+     *      Opaque state of the caller (the state machine's applied index and
+     *      sessions) that must stay consistent with the store's contents.
+     *      Kept under a reserved key that clients can't access and that is
+     *      not included in snapshots.
+     * \param sync
+     *      If true, the write (and every earlier one) is durable on return.
+     *      If false, a crash may lose this and other recent batches;
+     *      levelDB then recovers the store as of some earlier batch, whose
+     *      metadata comes back with it.
+     */
+    void commitBatch(const google::protobuf::Message& metadata, bool sync);
+
+    /**
+     * Discard the writes staged since beginBatch(), if any.
+     */
+    void abortBatch();
+
+    /**
+     * Read back the metadata last written by commitBatch().
+     * \return
+     *      True if found; false if the store has never had metadata
+     *      committed (for example, it is new or was just restored from a
+     *      snapshot).
+     */
+    bool readMetadata(google::protobuf::Message& metadata) const;
+
+    /**
+     * Reject keys that clients may not access: the KeepAlive RPC's reserved
+     * path and the store's reserved metadata keys.
+     * \return
+     *      Status and error message. Possible errors are:
+     *       - CONDITION_NOT_MET if key is reserved.
+     */
+    Result
+    checkReserved(const std::string& key) const;
 
     /**
      * Verify that the value at key has the given contents.
-     * Currently only used for filter away KeepAlive RPC.
+     * Sees writes staged in the current batch.
      * \param key
      *      The path to the file that must have the contents specified in
      *      'content'.
@@ -141,7 +271,7 @@ class Store: public boost::noncopyable {
      */
     Result
     checkCondition(const std::string& key,
-                   const std::string& content = "") const;
+                   const std::string& content) const;
 
     /**
      * Set the value of a key.
@@ -185,10 +315,74 @@ class Store: public boost::noncopyable {
     Result
     remove(const std::string& key);
 
+    /**
+     * Apply many writes and removes atomically: either all of them take
+     * effect, in order, or none does.
+     * \param ops
+     *      The operations to apply. Later operations on a key override
+     *      earlier ones.
+     * \return
+     *      Status and error message. Possible errors are:
+     *       - INVALID_ARGUMENT if any key or written content is empty.
+     *       - CONDITION_NOT_MET if any key is reserved (see checkReserved()).
+     *       - OPERATION_ERROR if levelDB operation return fail.
+     */
+    Result
+    batchWrite(const std::vector<BatchOp>& ops);
+
+    /**
+     * List the keys in [start, end] in ascending order.
+     * Equivalent to the full range() below without values or a cursor.
+     */
     Result
     range(const std::string& start, const std::string& end, uint64_t limit,
           std::vector<std::string>& range_store) const;
 
+    /**
+     * List the keys in [start, end], optionally with their values, one page
+     * at a time.
+     * \param start
+     *      The smallest key to return, or empty for no lower bound.
+     * \param end
+     *      The largest key to return, or empty for no upper bound.
+     * \param limit
+     *      If nonzero, return at most this many keys.
+     * \param reverse
+     *      If true, walk the range from end to start.
+     * \param cursor
+     *      Empty to begin at the start of the range, or the nextCursor of a
+     *      previous call with the same range and direction to continue where
+     *      it stopped.
+     * \param[out] range_store
+     *      The keys are appended here.
+     * \param[out] values
+     *      If not NULL, the value of each key is appended here.
+     * \param[out] nextCursor
+     *      Set to an opaque cursor if the limit stopped the listing before the
+     *      end of the range; otherwise, cleared.
+     * \return
+     *      Status and error message. Possible errors are:
+     *       - INVALID_ARGUMENT if the cursor is malformed.
+     */
+    Result
+    range(const std::string& start, const std::string& end, uint64_t limit,
+          bool reverse, const std::string& cursor,
+          std::vector<std::string>& range_store,
+          std::vector<std::string>* values,
+          std::string& nextCursor) const;
+
+    /**
+     * Find the keys containing the given substring, in sorted order.
+     * Patterns of at least TrigramIndex::MIN_PATTERN_LENGTH bytes are looked
+     * up in the search index (if enabled); shorter ones require a scan of
+     * the whole store.
+     * \param search_key
+     *      The substring to look for.
+     * \param limit
+     *      If nonzero, return at most this many keys.
+     * \param[out] search_store
+     *      The matching keys are appended here.
+     */
     Result
     search(const std::string& search_key, uint64_t limit,
            std::vector<std::string>& search_store) const;
@@ -205,6 +399,24 @@ class Store: public boost::noncopyable {
 
   private:
 
+    /**
+     * Look up the current value of a key, including writes staged in the
+     * current batch.
+     * \return
+     *      True if the key exists; false if not or if levelDB failed.
+     */
+    bool lookup(const std::string& key, std::string& content) const;
+
+    /**
+     * Open the levelDB database with the normal settings.
+     */
+    void openLevelDB();
+
+    /**
+     * Apply and clear a batch of restored keys (see loadSnapshot()).
+     */
+    void writeRestoreBatch(leveldb::WriteBatch& batch);
+
     // Server stats collected in updateServerStats.
     // Note that when a condition fails, the operation is not invoked,
     // so operations whose conditions fail are not counted as 'Attempted'.
@@ -215,9 +427,64 @@ class Store: public boost::noncopyable {
     uint64_t numRemoveAttempted;
     uint64_t numRemoveDone;
     uint64_t numRemoveSuccess;
+    uint64_t numBatchAttempted;
+    uint64_t numBatchSuccess;
+    uint64_t numBatchOps;
+    mutable uint64_t numConditionChecked;
+    mutable uint64_t numConditionNotMet;
+    mutable uint64_t numSearchIndexed;
+    mutable uint64_t numSearchScanned;
+    mutable uint64_t numSearchCandidates;
+    mutable uint64_t numSearchMatches;
+
+    /**
+     * If true, #searchIndex is maintained and used by search().
+     */
+    bool searchIndexEnabled;
+
+    /**
+     * Index of all client keys in the store, kept up to date by write(),
+     * remove() and loadSnapshot(), and rebuilt by init().
+     */
+    TrigramIndex searchIndex;
+
+    /**
+     * Approximate upper bound in bytes on the key/value data packed into
+     * each chunk written by dumpSnapshot().
+     */
+    uint64_t snapshotChunkBytes;
+
+    /**
+     * Approximate size in bytes of each leveldb::WriteBatch applied while
+     * restoring a snapshot.
+     */
+    uint64_t restoreBatchBytes;
+
+    /**
+     * The levelDB write buffer (memtable) size used while restoring a
+     * snapshot.
+     */
+    uint64_t restoreWriteBufferBytes;
 
     std::string levelDBPath_;
     std::unique_ptr<leveldb::DB> levelDB_;
+
+    /**
+     * Set between beginBatch() and commitBatch(): write() and remove() add
+     * to #batch rather than writing to levelDB directly.
+     */
+    bool batching;
+
+    /**
+     * Writes staged since beginBatch().
+     */
+    leveldb::WriteBatch batch;
+
+    /**
+     * The value each key was last given in #batch, so that read() sees
+     * staged writes. Keys removed in #batch map to NULL.
+     */
+    std::unordered_map<std::string, std::unique_ptr<std::string>> staged;
 };
 
 
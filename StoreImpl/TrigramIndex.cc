@@ -0,0 +1,179 @@
+/* Copyright (c) 2015 Diego Ongaro
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+#include "StoreImpl/TrigramIndex.h"
+
+namespace LogCabin {
+namespace Store {
+
+TrigramIndex::TrigramIndex()
+    : nextId(0)
+    , ids()
+    , keys()
+    , postings()
+    , numPostings(0)
+    , keyBytes(0)
+{
+}
+
+void
+TrigramIndex::clear()
+{
+    ids.clear();
+    keys.clear();
+    postings.clear();
+    numPostings = 0;
+    keyBytes = 0;
+}
+
+void
+TrigramIndex::insert(const std::string& key)
+{
+    auto inserted = ids.insert({key, nextId});
+    if (!inserted.second)
+        return;
+    KeyId id = nextId++;
+    keys[id] = &inserted.first->first;
+    keyBytes += key.length();
+
+    std::vector<uint32_t> grams = trigrams(key);
+    for (auto it = grams.begin(); it != grams.end(); ++it) {
+        postings[*it].push_back(id);
+        ++numPostings;
+    }
+}
+
+void
+TrigramIndex::remove(const std::string& key)
+{
+    auto idIt = ids.find(key);
+    if (idIt == ids.end())
+        return;
+    KeyId id = idIt->second;
+
+    std::vector<uint32_t> grams = trigrams(key);
+    for (auto it = grams.begin(); it != grams.end(); ++it) {
+        auto postingIt = postings.find(*it);
+        assert(postingIt != postings.end());
+        std::vector<KeyId>& list = postingIt->second;
+        auto pos = std::lower_bound(list.begin(), list.end(), id);
+        assert(pos != list.end() && *pos == id);
+        list.erase(pos);
+        --numPostings;
+        if (list.empty())
+            postings.erase(postingIt);
+    }
+
+    keyBytes -= key.length();
+    keys.erase(id);
+    ids.erase(idIt);
+}
+
+uint64_t
+TrigramIndex::search(const std::string& pattern,
+                     std::vector<std::string>& matches) const
+{
+    assert(pattern.length() >= MIN_PATTERN_LENGTH);
+
+    // Gather the posting list of every trigram in the pattern, shortest
+    // first. If any trigram is missing, nothing can match.
+    std::vector<const std::vector<KeyId>*> lists;
+    std::vector<uint32_t> grams = trigrams(pattern);
+    for (auto it = grams.begin(); it != grams.end(); ++it) {
+        auto postingIt = postings.find(*it);
+        if (postingIt == postings.end())
+            return 0;
+        lists.push_back(&postingIt->second);
+    }
+    std::sort(lists.begin(), lists.end(),
+              [](const std::vector<KeyId>* a, const std::vector<KeyId>* b) {
+                  return a->size() < b->size();
+              });
+
+    // Intersect them.
+    std::vector<KeyId> candidates(*lists.front());
+    for (size_t i = 1; i < lists.size() && !candidates.empty(); ++i) {
+        std::vector<KeyId> next;
+        std::set_intersection(candidates.begin(), candidates.end(),
+                              lists[i]->begin(), lists[i]->end(),
+                              std::back_inserter(next));
+        candidates.swap(next);
+    }
+
+    // Having all the trigrams doesn't mean the key contains the pattern, so
+    // check each candidate.
+    size_t oldSize = matches.size();
+    for (auto it = candidates.begin(); it != candidates.end(); ++it) {
+        const std::string& key = *keys.at(*it);
+        if (key.find(pattern) != std::string::npos)
+            matches.push_back(key);
+    }
+    std::sort(matches.begin() + oldSize, matches.end());
+    return candidates.size();
+}
+
+uint64_t
+TrigramIndex::getNumKeys() const
+{
+    return ids.size();
+}
+
+uint64_t
+TrigramIndex::getNumTrigrams() const
+{
+    return postings.size();
+}
+
+uint64_t
+TrigramIndex::getNumPostings() const
+{
+    return numPostings;
+}
+
+uint64_t
+TrigramIndex::getApproximateBytes() const
+{
+    // Ignores allocator and hash table overheads beyond one pointer per node.
+    return (keyBytes +
+            ids.size() * (sizeof(std::string) + sizeof(KeyId) + sizeof(void*)) +
+            keys.size() * (sizeof(KeyId) + 2 * sizeof(void*)) +
+            postings.size() * (sizeof(uint32_t) + sizeof(std::vector<KeyId>) +
+                               sizeof(void*)) +
+            numPostings * sizeof(KeyId));
+}
+
+std::vector<uint32_t>
+TrigramIndex::trigrams(const std::string& s)
+{
+    std::vector<uint32_t> grams;
+    if (s.length() < MIN_PATTERN_LENGTH)
+        return grams;
+    grams.reserve(s.length() - MIN_PATTERN_LENGTH + 1);
+    for (size_t i = 0; i + MIN_PATTERN_LENGTH <= s.length(); ++i) {
+        grams.push_back((uint32_t(uint8_t(s[i])) << 16) |
+                        (uint32_t(uint8_t(s[i + 1])) << 8) |
+                        uint32_t(uint8_t(s[i + 2])));
+    }
+    std::sort(grams.begin(), grams.end());
+    grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+    return grams;
+}
+
+} // namespace LogCabin::Store
+} // namespace LogCabin
@@ -0,0 +1,132 @@
+/* Copyright (c) 2015 Diego Ongaro
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR(S) DISCLAIM ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL AUTHORS BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#ifndef LOGCABIN_STOREIMPL_TRIGRAMINDEX_H
+#define LOGCABIN_STOREIMPL_TRIGRAMINDEX_H
+
+namespace LogCabin {
+namespace Store {
+
+/**
+ * An in-memory inverted index from every 3-byte substring (trigram) of a key
+ * to the keys containing it. Used by Store::search to find the keys that
+ * contain a given substring without scanning the whole store: only keys that
+ * contain every trigram of the pattern are candidates, and only those are
+ * checked against the pattern.
+ *
+ * This class is not thread-safe; Store callers serialize access to it.
+ */
+class TrigramIndex : public boost::noncopyable {
+  public:
+    /**
+     * Patterns shorter than this can't be looked up in the index.
+     */
+    static const size_t MIN_PATTERN_LENGTH = 3;
+
+    TrigramIndex();
+
+    /**
+     * Remove all keys from the index.
+     */
+    void clear();
+
+    /**
+     * Add a key to the index. Does nothing if it's already there.
+     */
+    void insert(const std::string& key);
+
+    /**
+     * Remove a key from the index. Does nothing if it's not there.
+     */
+    void remove(const std::string& key);
+
+    /**
+     * Find the indexed keys that contain the given pattern.
+     * \param pattern
+     *      The substring to search for. Must be at least MIN_PATTERN_LENGTH
+     *      bytes long.
+     * \param[out] matches
+     *      The keys containing 'pattern' are appended here, in sorted order.
+     * \return
+     *      The number of candidate keys that were checked against the pattern
+     *      (all of which contain each of its trigrams).
+     */
+    uint64_t search(const std::string& pattern,
+                    std::vector<std::string>& matches) const;
+
+    /// Return the number of keys in the index.
+    uint64_t getNumKeys() const;
+    /// Return the number of distinct trigrams in the index.
+    uint64_t getNumTrigrams() const;
+    /// Return the total length of all posting lists.
+    uint64_t getNumPostings() const;
+    /// Return a rough estimate of the memory used by the index, in bytes.
+    uint64_t getApproximateBytes() const;
+
+  private:
+    /**
+     * Identifies a key within the index. IDs are assigned in increasing order
+     * and never reused, so appending to a posting list keeps it sorted.
+     */
+    typedef uint64_t KeyId;
+
+    /**
+     * Return the distinct trigrams of 's', each packed into the low 24 bits
+     * of an integer, in sorted order.
+     */
+    static std::vector<uint32_t> trigrams(const std::string& s);
+
+    /**
+     * The ID to assign to the next key inserted.
+     */
+    KeyId nextId;
+
+    /**
+     * Maps each indexed key to its ID.
+     */
+    std::unordered_map<std::string, KeyId> ids;
+
+    /**
+     * Maps each ID back to its key, which is owned by #ids.
+     */
+    std::unordered_map<KeyId, const std::string*> keys;
+
+    /**
+     * Maps each trigram to the sorted IDs of the keys containing it.
+     */
+    std::unordered_map<uint32_t, std::vector<KeyId>> postings;
+
+    /**
+     * The total length of all lists in #postings.
+     */
+    uint64_t numPostings;
+
+    /**
+     * The total length of all keys in #ids.
+     */
+    uint64_t keyBytes;
+};
+
+} // namespace LogCabin::Store
+} // namespace LogCabin
+
+#endif // LOGCABIN_STOREIMPL_TRIGRAMINDEX_H
@@ -89,6 +89,9 @@ operator<<(std::ostream& os, Status status)
         case Status::TIMEOUT:
             os << "Status::TIMEOUT";
             break;
+        case Status::CONDITION_NOT_MET:
+            os << "Status::CONDITION_NOT_MET";
+            break;
     }
     return os;
 }
@@ -109,6 +112,20 @@ Result::Result(Status s)
     error = ss.str();
 }
 
+////////// struct BatchOperation //////////
+
+BatchOperation
+BatchOperation::write(const std::string& path, const std::string& contents)
+{
+    return BatchOperation {false, path, contents};
+}
+
+BatchOperation
+BatchOperation::remove(const std::string& path)
+{
+    return BatchOperation {true, path, ""};
+}
+
 ////////// TreeDetails //////////
 
 /**
@@ -119,6 +136,7 @@ class StoreDetails {
     StoreDetails(std::shared_ptr<ClientImpl> clientImpl)
         : clientImpl(clientImpl)
         , timeoutNanos(0)
+        , condition()
     {
     }
     /**
@@ -129,6 +147,10 @@ class StoreDetails {
      * If nonzero, a relative timeout in nanoseconds for all Store operations.
      */
     uint64_t timeoutNanos;
+    /**
+     * Predicate for read-write operations; see Store::setCondition().
+     */
+    ClientImpl::Condition condition;
 };
 
 
@@ -173,6 +195,22 @@ Store::setTimeout(uint64_t nanoseconds)
     storeDetails = newStoreDetails;
 }
 
+void
+Store::setCondition(const std::string& path, const std::string& value)
+{
+    std::lock_guard<std::mutex> lockGuard(mutex);
+    std::shared_ptr<StoreDetails> newStoreDetails(new StoreDetails(*storeDetails));
+    newStoreDetails->condition = {path, value};
+    storeDetails = newStoreDetails;
+}
+
+std::pair<std::string, std::string>
+Store::getCondition() const
+{
+    std::shared_ptr<const StoreDetails> storeDetails = getStoreDetails();
+    return storeDetails->condition;
+}
+
 Result
 Store::write(const std::string& path, const std::string& contents)
 {
@@ -180,6 +218,7 @@ Store::write(const std::string& path, const std::string& contents)
     return storeDetails->clientImpl->write(
         path,
         contents,
+        storeDetails->condition,
         ClientImpl::absTimeout(storeDetails->timeoutNanos));
 }
 
@@ -209,6 +248,30 @@ Store::remove(const std::string& path)
     std::shared_ptr<const StoreDetails> storeDetails = getStoreDetails();
     return storeDetails->clientImpl->remove(
         path,
+        storeDetails->condition,
+        ClientImpl::absTimeout(storeDetails->timeoutNanos));
+}
+
+Result
+Store::multiRead(const std::vector<std::string>& paths,
+                 std::vector<Result>& results,
+                 std::vector<std::string>& contents) const
+{
+    std::shared_ptr<const StoreDetails> storeDetails = getStoreDetails();
+    return storeDetails->clientImpl->multiRead(
+        paths,
+        ClientImpl::absTimeout(storeDetails->timeoutNanos),
+        results,
+        contents);
+}
+
+Result
+Store::batch(const std::vector<BatchOperation>& ops)
+{
+    std::shared_ptr<const StoreDetails> storeDetails = getStoreDetails();
+    return storeDetails->clientImpl->batch(
+        ops,
+        storeDetails->condition,
         ClientImpl::absTimeout(storeDetails->timeoutNanos));
 }
 
@@ -223,6 +286,21 @@ Store::range(const std::string& start_key, const std::string& end_key,
         contents);
 }
 
+Result
+Store::range(const std::string& start_key, const std::string& end_key,
+             uint64_t limit, bool reverse, bool includeValues,
+             const std::string& cursor,
+             std::vector<std::string>& keys,
+             std::vector<std::string>& values,
+             std::string& nextCursor)
+{
+    std::shared_ptr<const StoreDetails> storeDetails = getStoreDetails();
+    return storeDetails->clientImpl->range(
+        start_key, end_key, limit, reverse, includeValues, cursor,
+        ClientImpl::absTimeout(storeDetails->timeoutNanos),
+        keys, values, nextCursor);
+}
+
 Result
 Store::search(const std::string& search_key,
               uint64_t limit, std::vector<std::string>& contents)
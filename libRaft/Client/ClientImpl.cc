@@ -54,6 +54,9 @@ storeError(const Message& response)
         case Protocol::Client::Status::TIMEOUT:
             result.status = Status::TIMEOUT;
             break;
+        case Protocol::Client::Status::CONDITION_NOT_MET:
+            result.status = Status::CONDITION_NOT_MET;
+            break;
         case Protocol::Client::Status::SESSION_EXPIRED:
             PANIC("The client's session to the cluster expired. This is a "
                   "fatal error, since without a session the servers can't "
@@ -71,6 +74,19 @@ storeError(const Message& response)
     return result;
 }
 
+/**
+ * If the condition is set, attach it to a read-write request.
+ */
+void
+setCondition(Protocol::Client::ReadWriteStore::Request& request,
+             const ClientImpl::Condition& condition)
+{
+    if (!condition.first.empty()) {
+        request.mutable_condition()->set_path(condition.first);
+        request.mutable_condition()->set_contents(condition.second);
+    }
+}
+
 /**
  * Wrapper around LeaderRPC::call() that repackages a timeout as a
  * ReadOnlyTree status and error message.
@@ -435,7 +451,8 @@ ClientImpl::initDerived()
             RPC::Address(hosts, Protocol::Common::DEFAULT_PORT),
             clusterUUID,
             sessionCreationBackoff,
-            sessionManager));
+            sessionManager,
+            config.read<bool>("spreadReads", false)));
     }
 }
 
@@ -565,11 +582,13 @@ ClientImpl::getServerInfo(const std::string& host,
 Result
 ClientImpl::write(const std::string& path,
                   const std::string& content,
+                  const Condition& condition,
                   TimePoint timeout)
 {
     Protocol::Client::ReadWriteStore::Request request;
     *request.mutable_exactly_once() =
         exactlyOnceRPCHelper.getRPCInfo(timeout);
+    setCondition(request, condition);
     request.mutable_write()->set_path(path);
     request.mutable_write()->set_content(content);
     Protocol::Client::ReadWriteStore::Response response;
@@ -622,21 +641,52 @@ ClientImpl::range(const std::string& start_key,
                   TimePoint timeout,
                   std::vector<std::string>& contents) {
 
-    contents.clear();
+    std::vector<std::string> values;
+    std::string nextCursor;
+    return range(start_key, end_key, limit, false, false, "",
+                 timeout, contents, values, nextCursor);
+}
+
+Result
+ClientImpl::range(const std::string& start_key,
+                  const std::string& end_key,
+                  uint64_t limit,
+                  bool reverse,
+                  bool includeValues,
+                  const std::string& cursor,
+                  TimePoint timeout,
+                  std::vector<std::string>& keys,
+                  std::vector<std::string>& values,
+                  std::string& nextCursor) {
+
+    keys.clear();
+    values.clear();
+    nextCursor.clear();
     Protocol::Client::ReadOnlyStore::Request request;
     request.mutable_range()->set_start_key(start_key);
     request.mutable_range()->set_end_key(end_key);
     request.mutable_range()->set_limit(limit);
+    if (reverse)
+        request.mutable_range()->set_reverse(true);
+    if (includeValues)
+        request.mutable_range()->set_include_values(true);
+    if (!cursor.empty())
+        request.mutable_range()->set_cursor(cursor);
     Protocol::Client::ReadOnlyStore::Response response;
     storeCall(*leaderRPC,
               request, response, timeout);
     if (response.status() != Protocol::Client::Status::OK)
         return storeError(response);
 
-    contents.reserve(response.range().contents_size());
+    keys.reserve(response.range().contents_size());
     for (int i = 0; i < response.range().contents_size(); ++i) {
-        contents.push_back(response.range().contents(i));
+        keys.push_back(response.range().contents(i));
     }
+    values.reserve(response.range().values_size());
+    for (int i = 0; i < response.range().values_size(); ++i) {
+        values.push_back(response.range().values(i));
+    }
+    nextCursor = response.range().next_cursor();
     return Result();
 }
 
@@ -666,12 +716,14 @@ ClientImpl::search(const std::string& search_key,
 
 Result
 ClientImpl::remove(const std::string& path,
+                   const Condition& condition,
                    TimePoint timeout)
 {
     std::string realPath = path;
     Protocol::Client::ReadWriteStore::Request request;
     *request.mutable_exactly_once() =
         exactlyOnceRPCHelper.getRPCInfo(timeout);
+    setCondition(request, condition);
     request.mutable_remove()->set_path(realPath);
     Protocol::Client::ReadWriteStore::Response response;
     storeCall(*leaderRPC,
@@ -682,6 +734,72 @@ ClientImpl::remove(const std::string& path,
     return Result();
 }
 
+Result
+ClientImpl::multiRead(const std::vector<std::string>& paths,
+                      TimePoint timeout,
+                      std::vector<Result>& results,
+                      std::vector<std::string>& contents)
+{
+    results.clear();
+    contents.clear();
+    Protocol::Client::ReadOnlyStore::Request request;
+    for (auto it = paths.begin(); it != paths.end(); ++it)
+        request.mutable_multi_read()->add_path(*it);
+    Protocol::Client::ReadOnlyStore::Response response;
+    storeCall(*leaderRPC,
+              request, response, timeout);
+    if (response.status() != Protocol::Client::Status::OK)
+        return storeError(response);
+
+    const Protocol::Client::ReadOnlyStore::Response::MultiRead& multiRead =
+        response.multi_read();
+    if (uint64_t(multiRead.item_size()) != paths.size()) {
+        PANIC("Server returned %d results for a MultiRead of %lu paths",
+              multiRead.item_size(), paths.size());
+    }
+    results.reserve(paths.size());
+    contents.reserve(paths.size());
+    for (int i = 0; i < multiRead.item_size(); ++i) {
+        const Protocol::Client::ReadOnlyStore::Response::MultiRead::Item&
+            item = multiRead.item(i);
+        if (item.status() == Protocol::Client::Status::OK)
+            results.push_back(Result());
+        else
+            results.push_back(storeError(item));
+        contents.push_back(item.content());
+    }
+    return Result();
+}
+
+Result
+ClientImpl::batch(const std::vector<BatchOperation>& ops,
+                  const Condition& condition,
+                  TimePoint timeout)
+{
+    Protocol::Client::ReadWriteStore::Request request;
+    *request.mutable_exactly_once() =
+        exactlyOnceRPCHelper.getRPCInfo(timeout);
+    setCondition(request, condition);
+    Protocol::Client::ReadWriteStore::Request::Batch& batch =
+        *request.mutable_batch();
+    for (auto it = ops.begin(); it != ops.end(); ++it) {
+        auto& op = *batch.add_ops();
+        if (it->isRemove) {
+            op.mutable_remove()->set_path(it->path);
+        } else {
+            op.mutable_write()->set_path(it->path);
+            op.mutable_write()->set_content(it->contents);
+        }
+    }
+    Protocol::Client::ReadWriteStore::Response response;
+    storeCall(*leaderRPC,
+              request, response, timeout);
+    exactlyOnceRPCHelper.doneWithRPC(request.exactly_once());
+    if (response.status() != Protocol::Client::Status::OK)
+        return storeError(response);
+    return Result();
+}
+
 Result
 ClientImpl::serverControl(const std::string& host,
                           TimePoint timeout,
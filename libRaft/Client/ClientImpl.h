@@ -47,6 +47,9 @@ class ClientImpl {
     /// Type for absolute time values used for timeouts.
     typedef LeaderRPC::TimePoint TimePoint;
 
+    /// See Store::setCondition.
+    typedef std::pair<std::string, std::string> Condition;
+
     /**
      * Return the absolute time when the calling operation should timeout.
      * \param relTimeoutNanos
@@ -103,6 +106,7 @@ class ClientImpl {
 
     Result write(const std::string& path,
                  const std::string& content,
+                 const Condition& condition,
                  TimePoint timeout);
 
     Result stat(const std::string& client,
@@ -113,12 +117,32 @@ class ClientImpl {
                 TimePoint timeout,
                 std::string& content);
 
+    Result multiRead(const std::vector<std::string>& paths,
+                     TimePoint timeout,
+                     std::vector<Result>& results,
+                     std::vector<std::string>& contents);
+
+    Result batch(const std::vector<BatchOperation>& ops,
+                 const Condition& condition,
+                 TimePoint timeout);
+
     Result range(const std::string& start_key,
                  const std::string& end_key,
                  uint64_t limit,
                  TimePoint timeout,
                  std::vector<std::string>& contents);
 
+    Result range(const std::string& start_key,
+                 const std::string& end_key,
+                 uint64_t limit,
+                 bool reverse,
+                 bool includeValues,
+                 const std::string& cursor,
+                 TimePoint timeout,
+                 std::vector<std::string>& keys,
+                 std::vector<std::string>& values,
+                 std::string& nextCursor);
+
     Result search(const std::string& search_key,
                   uint64_t limit,
                   TimePoint timeout,
@@ -126,6 +150,7 @@ class ClientImpl {
 
     /// See Tree::removeFile.
     Result remove(const std::string& path,
+                  const Condition& condition,
                   TimePoint timeout);
 
 
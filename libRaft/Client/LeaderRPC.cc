@@ -72,6 +72,7 @@ LeaderRPC::Call::Call(LeaderRPC& leaderRPC)
     : leaderRPC(leaderRPC)
     , cachedSession()
     , rpc()
+    , isRead(false)
 {
 }
 
@@ -84,8 +85,13 @@ LeaderRPC::Call::start(OpCode opCode,
                        const google::protobuf::Message& request,
                        TimePoint timeout)
 {
-    // Save a reference to the leaderSession
-    cachedSession = leaderRPC.getSession(timeout);
+    // Save a reference to the leaderSession (or readSession)
+    isRead = (leaderRPC.spreadReads &&
+              opCode == Protocol::Client::OpCode::STATE_MACHINE_QUERY);
+    if (isRead)
+        cachedSession = leaderRPC.getReadSession(timeout);
+    else
+        cachedSession = leaderRPC.getSession(timeout);
     rpc = RPC::ClientRPC(cachedSession,
                          Protocol::Common::ServiceId::CLIENT_SERVICE,
                          1,
@@ -108,16 +114,21 @@ LeaderRPC::Call::wait(google::protobuf::Message& response,
     Protocol::Client::Error error;
     RPCStatus status = rpc.waitForReply(&response, &error, timeout);
 
-    // Decode the response
+    // Decode the response. Reads spread over the cluster just move on to
+    // another random server if this one couldn't serve them, so they report
+    // through reportReadFailure() and leave the leader session alone.
     switch (status) {
         case RPCStatus::OK:
-            leaderRPC.reportSuccess(cachedSession);
+            if (!isRead)
+                leaderRPC.reportSuccess(cachedSession);
             return Call::Status::OK;
         case RPCStatus::SERVICE_SPECIFIC_ERROR:
             switch (error.error_code()) {
                 case Protocol::Client::Error::NOT_LEADER:
                     // The server we tried is not the current cluster leader.
-                    if (error.has_leader_hint()) {
+                    if (isRead) {
+                        leaderRPC.reportReadFailure(cachedSession);
+                    } else if (error.has_leader_hint()) {
                         leaderRPC.reportRedirect(cachedSession,
                                                  error.leader_hint());
                     } else {
@@ -136,7 +147,10 @@ LeaderRPC::Call::wait(google::protobuf::Message& response,
             }
             break;
         case RPCStatus::RPC_FAILED:
-            leaderRPC.reportFailure(cachedSession);
+            if (isRead)
+                leaderRPC.reportReadFailure(cachedSession);
+            else
+                leaderRPC.reportFailure(cachedSession);
             break;
         case RPCStatus::RPC_CANCELED:
             break;
@@ -159,7 +173,8 @@ LeaderRPC::Call::wait(google::protobuf::Message& response,
 LeaderRPC::LeaderRPC(const RPC::Address& hosts,
                      SessionManager::ClusterUUID& clusterUUID,
                      Backoff& sessionCreationBackoff,
-                     SessionManager& sessionManager)
+                     SessionManager& sessionManager,
+                     bool spreadReads)
     : clusterUUID(clusterUUID)
     , sessionCreationBackoff(sessionCreationBackoff)
     , sessionManager(sessionManager)
@@ -170,12 +185,15 @@ LeaderRPC::LeaderRPC(const RPC::Address& hosts,
     , leaderHint()
     , leaderSession() // set by connect()
     , failuresSinceLastSuccess(0)
+    , spreadReads(spreadReads)
+    , readSession()
 {
 }
 
 LeaderRPC::~LeaderRPC()
 {
     leaderSession.reset();
+    readSession.reset();
 }
 
 LeaderRPC::Status
@@ -280,6 +298,48 @@ LeaderRPC::getSession(TimePoint timeout)
     return leaderSession;
 }
 
+std::shared_ptr<RPC::ClientSession>
+LeaderRPC::getReadSession(TimePoint timeout)
+{
+    std::unique_lock<std::mutex> lockGuard(mutex);
+    if (readSession)
+        return readSession;
+    RPC::Address address = hosts;
+
+    // Several threads may race to create a read session here; that's
+    // harmless, since any of them will do and the rest are dropped.
+    std::shared_ptr<RPC::ClientSession> session;
+    {
+        Core::MutexUnlock<std::mutex> unlockGuard(lockGuard);
+        sessionCreationBackoff.delayAndBegin(timeout);
+        if (Clock::now() > timeout) {
+            return RPC::ClientSession::makeErrorSession(
+                    sessionManager.eventLoop,
+                    "Failed to create session for reads: timeout expired");
+        }
+        address.refresh(timeout);
+        VERBOSE("Connecting to %s for reads", address.toString().c_str());
+        session = sessionManager.createSession(
+                address,
+                timeout,
+                &clusterUUID);
+    }
+    if (!readSession)
+        readSession = session;
+    return readSession;
+}
+
+void
+LeaderRPC::reportReadFailure(std::shared_ptr<RPC::ClientSession> cachedSession)
+{
+    std::lock_guard<std::mutex> lockGuard(mutex);
+    if (cachedSession != readSession)
+        return;
+    VERBOSE("Server [%s] could not serve read, will try random host next",
+            cachedSession->toString().c_str());
+    readSession.reset();
+}
+
 void
 LeaderRPC::reportFailure(std::shared_ptr<RPC::ClientSession> cachedSession)
 {
@@ -235,11 +235,15 @@ class LeaderRPC : public LeaderRPCBase {
      *      Used to rate-limit new TCP connections.
      * \param sessionManager
      *      Used to create new sessions.
+     * \param spreadReads
+     *      If true, send STATE_MACHINE_QUERY RPCs to random hosts rather than
+     *      the leader, so that followers can serve them.
      */
     LeaderRPC(const RPC::Address& hosts,
               SessionManager::ClusterUUID& clusterUUID,
               Backoff& sessionCreationBackoff,
-              SessionManager& sessionManager);
+              SessionManager& sessionManager,
+              bool spreadReads = false);
 
     /// Destructor.
     ~LeaderRPC();
@@ -268,14 +272,18 @@ class LeaderRPC : public LeaderRPCBase {
                     TimePoint timeout);
         LeaderRPC& leaderRPC;
         /**
-         * Copy of leaderSession when the RPC was started (might have changed
-         * since).
+         * Copy of leaderSession (or readSession, if #isRead) when the RPC was
+         * started (might have changed since).
          */
         std::shared_ptr<RPC::ClientSession> cachedSession;
         /**
          * RPC object which may be canceled.
          */
         RPC::ClientRPC rpc;
+        /**
+         * True if this RPC was sent on readSession rather than leaderSession.
+         */
+        bool isRead;
     };
 
     /**
@@ -290,6 +298,30 @@ class LeaderRPC : public LeaderRPCBase {
     std::shared_ptr<RPC::ClientSession>
     getSession(TimePoint timeout);
 
+    /**
+     * Return a session connected to a random server for read-only RPCs,
+     * creating it if necessary. Only used if #spreadReads is set.
+     * \param timeout
+     *      After this time has elapsed, stop trying to initiate the connection
+     *      and return an invalid session.
+     * \return
+     *      Session on which to execute read-only RPCs.
+     */
+    std::shared_ptr<RPC::ClientSession>
+    getReadSession(TimePoint timeout);
+
+    /**
+     * Notify this class that a read-only RPC on the given session failed or
+     * was rejected. This will cause this class to connect to another random
+     * server next time getReadSession() is called.
+     * \param cachedSession
+     *      Session previously returned by getReadSession(). This is used to
+     *      detect races in which some other thread has already solved the
+     *      problem.
+     */
+    void
+    reportReadFailure(std::shared_ptr<RPC::ClientSession> cachedSession);
+
     /**
      * Notify this class that an RPC on the given session failed. This will
      * usually cause this class to connect to a random server next time
@@ -395,6 +427,17 @@ class LeaderRPC : public LeaderRPCBase {
      * two.
      */
     uint64_t failuresSinceLastSuccess;
+
+    /**
+     * If true, read-only RPCs go to #readSession instead of #leaderSession.
+     */
+    const bool spreadReads;
+
+    /**
+     * Session connected to a random server, used for read-only RPCs when
+     * #spreadReads is set. Null until the first such RPC and after failures.
+     */
+    std::shared_ptr<RPC::ClientSession> readSession;
 };
 
 } // namespace LogCabin::Client
@@ -14,6 +14,8 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <endian.h>
+
 #include <map>
 #include <memory>
 #include <mutex>
@@ -29,6 +31,10 @@
 #include <cryptopp/tiger.h>
 #include <cryptopp/ripemd.h>
 
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
 #include "Core/Debug.h"
 #include "Core/Checksum.h"
 #include "Core/STLUtil.h"
@@ -44,6 +50,191 @@ using Core::StringUtil::format;
 
 namespace {
 
+/**
+ * CRC-32C (Castagnoli), as used by iSCSI, ext4, and others. Unlike Crypto++'s
+ * CRC32, this uses the SSE4.2 crc32 instruction when the CPU supports it,
+ * falling back to a slicing-by-8 table implementation otherwise. The digest is
+ * the 4-byte CRC in little-endian byte order, matching CryptoPP::CRC32.
+ */
+class CRC32C : public CryptoPP::HashTransformation {
+  public:
+    CRC32C()
+        : crc(~0U)
+    {
+    }
+    static const char* StaticAlgorithmName() {
+        return "CRC32C";
+    }
+    std::string AlgorithmName() const {
+        return StaticAlgorithmName();
+    }
+    unsigned int DigestSize() const {
+        return 4;
+    }
+    void Update(const uint8_t* input, size_t length) {
+        crc = (*update)(crc, input, length);
+    }
+    void TruncatedFinal(uint8_t* hash, size_t size) {
+        ThrowIfInvalidTruncatedSize(size);
+        uint32_t result = crc ^ ~0U;
+        for (size_t i = 0; i < size; ++i)
+            hash[i] = uint8_t(result >> (8 * i));
+        crc = ~0U;
+    }
+
+    /**
+     * Function type for the implementations below. Takes the running
+     * (inverted) CRC and returns it updated with the given bytes.
+     */
+    typedef uint32_t (*UpdateFn)(uint32_t crc,
+                                 const uint8_t* data, size_t length);
+
+    /**
+     * Software implementation using slicing-by-8.
+     */
+    static uint32_t updateSoftware(uint32_t crc,
+                                   const uint8_t* data, size_t length);
+
+    /**
+     * Implementation using the SSE4.2 crc32 instruction. Only call this if
+     * the CPU supports SSE4.2.
+     */
+    static uint32_t updateHardware(uint32_t crc,
+                                   const uint8_t* data, size_t length);
+
+    /**
+     * Lookup tables for updateSoftware(). table[0] is the usual byte-at-a-time
+     * table; table[k][b] is the CRC of byte b followed by k zero bytes.
+     */
+    struct Table {
+        Table();
+        uint32_t table[8][256];
+    };
+    static const Table table;
+
+    /**
+     * The implementation chosen for this CPU when the program starts.
+     */
+    static const UpdateFn update;
+
+  private:
+    /**
+     * The running CRC, inverted.
+     */
+    uint32_t crc;
+};
+
+CRC32C::Table::Table()
+{
+    // Reversed Castagnoli polynomial.
+    const uint32_t poly = 0x82F63B78;
+    for (uint32_t b = 0; b < 256; ++b) {
+        uint32_t crc = b;
+        for (uint32_t k = 0; k < 8; ++k)
+            crc = (crc >> 1) ^ (poly & (0U - (crc & 1)));
+        table[0][b] = crc;
+    }
+    for (uint32_t b = 0; b < 256; ++b) {
+        for (uint32_t k = 1; k < 8; ++k) {
+            uint32_t prev = table[k - 1][b];
+            table[k][b] = (prev >> 8) ^ table[0][prev & 0xff];
+        }
+    }
+}
+
+const CRC32C::Table CRC32C::table;
+
+uint32_t
+CRC32C::updateSoftware(uint32_t crc, const uint8_t* data, size_t length)
+{
+    const uint32_t (&t)[8][256] = table.table;
+    while (length > 0 && (reinterpret_cast<uintptr_t>(data) & 7) != 0) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *data) & 0xff];
+        ++data;
+        --length;
+    }
+    while (length >= 8) {
+        uint32_t lo;
+        uint32_t hi;
+        memcpy(&lo, data, 4);
+        memcpy(&hi, data + 4, 4);
+        lo = le32toh(lo) ^ crc;
+        hi = le32toh(hi);
+        crc = (t[7][lo & 0xff] ^
+               t[6][(lo >> 8) & 0xff] ^
+               t[5][(lo >> 16) & 0xff] ^
+               t[4][lo >> 24] ^
+               t[3][hi & 0xff] ^
+               t[2][(hi >> 8) & 0xff] ^
+               t[1][(hi >> 16) & 0xff] ^
+               t[0][hi >> 24]);
+        data += 8;
+        length -= 8;
+    }
+    while (length > 0) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *data) & 0xff];
+        ++data;
+        --length;
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("sse4.2")))
+uint32_t
+CRC32C::updateHardware(uint32_t crc, const uint8_t* data, size_t length)
+{
+    while (length > 0 && (reinterpret_cast<uintptr_t>(data) & 7) != 0) {
+        crc = _mm_crc32_u8(crc, *data);
+        ++data;
+        --length;
+    }
+    uint64_t crc64 = crc;
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+        length -= 8;
+    }
+    crc = uint32_t(crc64);
+    while (length > 0) {
+        crc = _mm_crc32_u8(crc, *data);
+        ++data;
+        --length;
+    }
+    return crc;
+}
+
+/**
+ * Pick updateHardware() if the CPU supports it. This runs during static
+ * initialization, possibly before libgcc has probed the CPU itself.
+ */
+CRC32C::UpdateFn
+chooseCRC32CUpdate()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2"))
+        return CRC32C::updateHardware;
+    else
+        return CRC32C::updateSoftware;
+}
+
+const CRC32C::UpdateFn CRC32C::update = chooseCRC32CUpdate();
+
+#else /* !defined(__x86_64__) */
+
+uint32_t
+CRC32C::updateHardware(uint32_t crc, const uint8_t* data, size_t length)
+{
+    return updateSoftware(crc, data, length);
+}
+
+const CRC32C::UpdateFn CRC32C::update = CRC32C::updateSoftware;
+
+#endif /* defined(__x86_64__) */
+
 /**
  * Helper for writeChecksum template, to keep code bloat to a minimum.
  */
@@ -144,6 +335,7 @@ class Algorithms {
         : byName()
     {
         registerAlgorithm<CryptoPP::CRC32>();
+        registerAlgorithm<CRC32C>();
         registerAlgorithm<CryptoPP::Adler32>();
         registerAlgorithm<CryptoPP::Weak::MD5>();
         registerAlgorithm<CryptoPP::SHA1>();
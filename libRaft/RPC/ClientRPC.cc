@@ -95,6 +95,12 @@ ClientRPC::isReady()
     return opaqueRPC.getStatus() != OpaqueClientRPC::Status::NOT_READY;
 }
 
+void
+ClientRPC::setCallback(std::function<void()> callback)
+{
+    opaqueRPC.setCallback(std::move(callback));
+}
+
 ClientRPC::Status
 ClientRPC::waitForReply(google::protobuf::Message* response,
                         google::protobuf::Message* serviceSpecificError,
@@ -15,6 +15,7 @@
  */
 
 #include <cinttypes>
+#include <functional>
 #include <google/protobuf/message.h>
 #include <iostream>
 #include <memory>
@@ -104,6 +105,13 @@ class ClientRPC {
      */
     bool isReady();
 
+    /**
+     * Arrange for the given function to be called once the RPC is ready.
+     * See OpaqueClientRPC::setCallback() for the restrictions on what the
+     * function may do.
+     */
+    void setCallback(std::function<void()> callback);
+
     /**
      * The return type of waitForReply().
      */
@@ -129,7 +129,7 @@ ClientSession::MessageSocketHandler::handleReceivedMessage(
     // Fill in the response
     response.status = Response::HAS_REPLY;
     response.reply = std::move(message);
-    response.ready.notify_all();
+    response.notifyReady();
 }
 
 void
@@ -147,7 +147,7 @@ ClientSession::MessageSocketHandler::handleDisconnect()
              it != session.responses.end();
              ++it) {
             Response* response = it->second;
-            response->ready.notify_all();
+            response->notifyReady();
         }
     }
 }
@@ -159,9 +159,21 @@ ClientSession::Response::Response()
     , reply()
     , hasWaiter(false)
     , ready()
+    , callback()
 {
 }
 
+void
+ClientSession::Response::notifyReady()
+{
+    ready.notify_all();
+    if (callback) {
+        std::function<void()> fn = std::move(callback);
+        callback = nullptr;
+        fn();
+    }
+}
+
 ////////// ClientSession::Timer //////////
 
 ClientSession::Timer::Timer(ClientSession& session)
@@ -206,7 +218,7 @@ ClientSession::Timer::handleTimerEvent()
              it != session.responses.end();
              ++it) {
             Response* response = it->second;
-            response->ready.notify_all();
+            response->notifyReady();
         }
     }
 }
@@ -489,6 +501,29 @@ ClientSession::update(OpaqueClientRPC& rpc)
     responses.erase(it);
 }
 
+void
+ClientSession::setCallback(OpaqueClientRPC& rpc,
+                           std::function<void()> callback)
+{
+    // The RPC may be holding the last reference to this session. This
+    // temporary reference makes sure this object isn't destroyed until after
+    // we return from this method. It must be the first line in this method.
+    std::shared_ptr<ClientSession> selfGuard(self.lock());
+
+    std::unique_lock<std::mutex> mutexGuard(mutex);
+    auto it = responses.find(rpc.responseToken);
+    if (it != responses.end() &&
+        it->second->status == Response::WAITING &&
+        errorMessage.empty()) {
+        it->second->callback = std::move(callback);
+        return;
+    }
+    // Already ready (or canceled): no event will fire later, so run the
+    // callback now, outside the session's lock.
+    mutexGuard.unlock();
+    callback();
+}
+
 void
 ClientSession::wait(const OpaqueClientRPC& rpc, TimePoint timeout)
 {
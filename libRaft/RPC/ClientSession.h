@@ -14,6 +14,7 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -165,6 +166,12 @@ class ClientSession {
          * Constructor.
          */
         Response();
+        /**
+         * Wake up any thread blocked on #ready and run #callback, if one is
+         * set. Called with the session's mutex held when a reply arrives or
+         * the session fails; not called when the RPC is canceled.
+         */
+        void notifyReady();
         /**
          * Current state of the RPC.
          */
@@ -198,6 +205,11 @@ class ClientSession {
          * is disconnected, or the RPC is canceled.
          */
         Core::ConditionVariable ready;
+        /**
+         * If set, invoked once from notifyReady(). See
+         * OpaqueClientRPC::setCallback().
+         */
+        std::function<void()> callback;
     };
 
     /**
@@ -213,7 +225,8 @@ class ClientSession {
         ClientSession& session;
     };
 
-    // The cancel(), update(), and wait() methods are used by OpaqueClientRPC.
+    // The cancel(), update(), wait(), and setCallback() methods are used by
+    // OpaqueClientRPC.
     friend class OpaqueClientRPC;
 
     /**
@@ -247,6 +260,16 @@ class ClientSession {
      */
     void wait(const OpaqueClientRPC& rpc, TimePoint timeout);
 
+    /**
+     * Called by the RPC to register a function to run once its response is
+     * ready (non-blocking). If the response is already available or the
+     * session has already failed, the function is run immediately from the
+     * calling thread.
+     *
+     * This may be called while holding the RPC's lock.
+     */
+    void setCallback(OpaqueClientRPC& rpc, std::function<void()> callback);
+
     /**
      * This is used to keep this object alive while there are outstanding RPCs.
      */
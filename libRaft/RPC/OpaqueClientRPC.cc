@@ -118,6 +118,18 @@ OpaqueClientRPC::waitForReply(TimePoint timeout)
     }
 }
 
+void
+OpaqueClientRPC::setCallback(std::function<void()> callback)
+{
+    std::unique_lock<std::mutex> mutexGuard(mutex);
+    if (status == Status::NOT_READY && session) {
+        session->setCallback(*this, std::move(callback));
+        return;
+    }
+    mutexGuard.unlock();
+    callback();
+}
+
 ///// private methods /////
 
 void
@@ -15,6 +15,7 @@
  */
 
 #include <cinttypes>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <stdexcept>
@@ -136,6 +137,22 @@ class OpaqueClientRPC {
      */
     void waitForReply(TimePoint timeout);
 
+    /**
+     * Arrange for the given function to be called once the reply is ready
+     * or an error has occurred, without blocking a thread on the RPC.
+     *
+     * The function usually runs on the event loop thread with the
+     * ClientSession's internal lock held, so it must be short, must not
+     * block, and must not call back into this RPC; it typically just hands
+     * the RPC off to a worker thread that then calls the usual accessors.
+     * If the RPC is already complete, the function runs immediately from
+     * the calling thread. It is not called if the RPC is canceled.
+     *
+     * \param callback
+     *      Function to invoke once. Replaces any callback set earlier.
+     */
+    void setCallback(std::function<void()> callback);
+
   private:
 
     /**
@@ -178,6 +178,11 @@ ClientService::stateMachineQuery(RPC::ServerRPC rpc)
 {
     PRELUDE(StateMachineQuery);
     std::pair<Result, uint64_t> result = globals.raft->getLastCommitIndex();
+    if (result.first == Result::NOT_LEADER) {
+        // Followers may serve the read once they have applied the leader's
+        // commit index (if enabled).
+        result = globals.raft->getReadIndexFromLeader();
+    }
     if (result.first == Result::RETRY || result.first == Result::NOT_LEADER) {
         Protocol::Client::Error error;
         error.set_error_code(Protocol::Client::Error::NOT_LEADER);
@@ -103,6 +103,13 @@ LocalServer::getLastAckEpoch() const
     return consensus.currentEpoch;
 }
 
+uint64_t
+LocalServer::getLastAckSentNanos() const
+{
+    // The local server always agrees with itself.
+    return ~0UL;
+}
+
 uint64_t
 LocalServer::getMatchIndex() const
 {
@@ -171,6 +178,7 @@ Peer::Peer(uint64_t serverId, RaftConsensus& consensus)
     , nextIndex(consensus.log->getLastLogIndex() + 1)
     , matchIndex(0)
     , lastAckEpoch(0)
+    , lastAckSentNanos(0)
     , nextHeartbeatTime(TimePoint::min())
     , backoffUntil(TimePoint::min())
     , rpcFailuresSinceLastWarning(0)
@@ -181,8 +189,9 @@ Peer::Peer(uint64_t serverId, RaftConsensus& consensus)
     , snapshotFile()
     , snapshotFileOffset(0)
     , lastSnapshotIndex(0)
+    , appendEntriesInFlight()
+    , pendingRPC()
     , session()
-    , rpc()
 {
 }
 
@@ -206,6 +215,8 @@ Peer::beginLeadership()
     snapshotFile.reset();
     snapshotFileOffset = 0;
     lastSnapshotIndex = 0;
+    // Acknowledgements from earlier terms say nothing about this one.
+    lastAckSentNanos = 0;
 }
 
 void
@@ -228,6 +239,12 @@ Peer::getLastAckEpoch() const
     return lastAckEpoch;
 }
 
+uint64_t
+Peer::getLastAckSentNanos() const
+{
+    return lastAckSentNanos;
+}
+
 uint64_t
 Peer::getMatchIndex() const
 {
@@ -243,7 +260,17 @@ Peer::haveVote() const
 void
 Peer::interrupt()
 {
-    rpc.cancel();
+    if (pendingRPC)
+        pendingRPC->rpc.cancel();
+    for (auto it = appendEntriesInFlight.begin();
+         it != appendEntriesInFlight.end();
+         ++it) {
+        it->rpc.cancel();
+    }
+    // Canceled RPCs don't invoke their callbacks, so make sure their entries
+    // get cleaned up.
+    if (pendingRPC || !appendEntriesInFlight.empty())
+        consensus.queueReplicationWork(weakSelf);
 }
 
 bool
@@ -258,21 +285,26 @@ Peer::scheduleHeartbeat()
     nextHeartbeatTime = Clock::now();
 }
 
+RPC::ClientRPC
+Peer::startRPC(Protocol::Raft::OpCode opCode,
+               const google::protobuf::Message& request,
+               std::unique_lock<Mutex>& lockGuard)
+{
+    return RPC::ClientRPC(getSession(lockGuard),
+                          Protocol::Common::ServiceId::RAFT_SERVICE,
+                          /* serviceSpecificErrorVersion = */ 0,
+                          opCode,
+                          request);
+}
+
 Peer::CallStatus
-Peer::callRPC(Protocol::Raft::OpCode opCode,
-              const google::protobuf::Message& request,
-              google::protobuf::Message& response,
-              std::unique_lock<Mutex>& lockGuard)
+Peer::decodeReply(RPC::ClientRPC& rpc,
+                  google::protobuf::Message& response)
 {
     typedef RPC::ClientRPC::Status RPCStatus;
-    rpc = RPC::ClientRPC(getSession(lockGuard),
-                         Protocol::Common::ServiceId::RAFT_SERVICE,
-                         /* serviceSpecificErrorVersion = */ 0,
-                         opCode,
-                         request);
-    // release lock for concurrency
-    Core::MutexUnlock<Mutex> unlockGuard(lockGuard);
-    switch (rpc.waitForReply(&response, NULL, TimePoint::max())) {
+    assert(rpc.isReady());
+    RPCStatus status = rpc.waitForReply(&response, NULL, TimePoint::max());
+    switch (status) {
         case RPCStatus::OK:
             if (rpcFailuresSinceLastWarning > 0) {
                 WARNING("RPC to server succeeded after %lu failures",
@@ -305,11 +337,50 @@ Peer::callRPC(Protocol::Raft::OpCode opCode,
     PANIC("Unexpected RPC status");
 }
 
+Peer::AppendEntriesRPC::AppendEntriesRPC(uint64_t term,
+                                         uint64_t prevLogIndex,
+                                         uint64_t numEntries,
+                                         uint64_t epoch,
+                                         TimePoint start)
+    : term(term)
+    , prevLogIndex(prevLogIndex)
+    , numEntries(numEntries)
+    , epoch(epoch)
+    , start(start)
+    , rpc()
+{
+}
+
+Peer::AppendEntriesRPC::AppendEntriesRPC(AppendEntriesRPC&& other)
+    : term(other.term)
+    , prevLogIndex(other.prevLogIndex)
+    , numEntries(other.numEntries)
+    , epoch(other.epoch)
+    , start(other.start)
+    , rpc(std::move(other.rpc))
+{
+}
+
+Peer::PendingRPC::PendingRPC(Protocol::Raft::OpCode opCode,
+                             uint64_t term,
+                             uint64_t epoch,
+                             TimePoint start,
+                             uint64_t numDataBytes)
+    : opCode(opCode)
+    , term(term)
+    , epoch(epoch)
+    , start(start)
+    , numDataBytes(numDataBytes)
+    , rpc()
+{
+}
+
 void
 Peer::startThread(std::shared_ptr<Peer> self)
 {
     thisCatchUpIterationStart = Clock::now();
     thisCatchUpIterationGoalId = consensus.log->getLastLogIndex();
+    weakSelf = self;
     ++consensus.numPeerThreads;
     NOTICE("Starting peer thread for server %lu", serverId);
     std::thread(&RaftConsensus::peerThreadMain, &consensus, self).detach();
@@ -381,6 +452,10 @@ Peer::updatePeerStats(Protocol::ServerStats::Raft::Peer& peerStats,
             peerStats.set_next_index(nextIndex);
             peerStats.set_last_agree_index(matchIndex);
             peerStats.set_is_caught_up(isCaughtUp_);
+            peerStats.set_append_entries_in_flight(
+                appendEntriesInFlight.size());
+            peerStats.set_max_append_entries_in_flight(
+                consensus.MAX_APPEND_ENTRIES_IN_FLIGHT);
             peerStats.set_next_heartbeat_at(time.unixNanos(nextHeartbeatTime));
             break;
     }
@@ -877,12 +952,25 @@ struct StagingProgressing {
 
 } // namespace RaftConsensusInternal
 
+////////// RaftConsensus::Proposal //////////
+
+RaftConsensus::Proposal::Proposal(const Core::Buffer& operation)
+    : operation(operation)
+    , next(NULL)
+    , enqueued(Clock::now())
+    , done(false)
+    , term(0)
+    , index(0)
+{
+}
+
 ////////// RaftConsensus::Entry //////////
 
 RaftConsensus::Entry::Entry()
     : index(0)
     , type(SKIP)
     , command()
+    , logEntry()
     , snapshotReader()
     , clusterTime(0)
 {
@@ -892,6 +980,7 @@ RaftConsensus::Entry::Entry(Entry&& other)
     : index(other.index)
     , type(other.type)
     , command(std::move(other.command))
+    , logEntry(std::move(other.logEntry))
     , snapshotReader(std::move(other.snapshotReader))
     , clusterTime(other.clusterTime)
 {
@@ -927,6 +1016,33 @@ RaftConsensus::RaftConsensus(Globals& globals)
                     globals.config.read<uint64_t>(
                         "rpcFailureBackoffMilliseconds")))
             : (ELECTION_TIMEOUT / 2))
+    , LEADER_LEASE(
+        std::chrono::milliseconds(
+            globals.config.read<uint64_t>(
+                "leaderLeaseMilliseconds",
+                0)))
+    , FOLLOWER_READS(globals.config.read<bool>("followerReads", false))
+    , MAX_APPEND_ENTRIES_IN_FLIGHT(
+        std::max(globals.config.read<uint64_t>(
+                    "maxAppendEntriesInFlight",
+                    1),
+                 uint64_t(1)))
+    , REPLICATION_THREADS(
+        std::max(globals.config.read<uint64_t>(
+                    "replicationThreads",
+                    2),
+                 uint64_t(1)))
+    , ASYNC_FOLLOWER_SYNC(
+        globals.config.read<bool>("asyncFollowerSync", true))
+    , MAX_PROPOSAL_BATCH_ENTRIES(
+        globals.config.read<uint64_t>(
+            "maxProposalBatchEntries",
+            1000))
+    , PROPOSAL_BATCH_DELAY(
+        std::chrono::microseconds(
+            globals.config.read<uint64_t>(
+                "proposalBatchDelayMicroseconds",
+                0)))
     , SOFT_RPC_SIZE_LIMIT(Protocol::Common::MAX_MESSAGE_LENGTH - 1024)
     , serverId(0)
     , serverAddresses()
@@ -936,11 +1052,18 @@ RaftConsensus::RaftConsensus(Globals& globals)
                      globals.config)
     , mutex()
     , stateChanged()
+    , commitMutex()
+    , commitChanged()
+    , publishedCommitIndex(0)
+    , publishedApplicableIndex(0)
+    , publishedTerm(0)
+    , publishedExiting(false)
     , exiting(false)
     , numPeerThreads(0)
     , log()
     , logSyncQueued(false)
-    , leaderDiskThreadWorking(false)
+    , diskThreadWorking(false)
+    , logSyncGeneration(0)
     , configuration()
     , configurationManager()
     , currentTerm(0)
@@ -955,27 +1078,71 @@ RaftConsensus::RaftConsensus(Globals& globals)
     , leaderId(0)
     , votedFor(0)
     , currentEpoch(0)
+    , lastEpochSent(0)
+    , lastEpochScheduled(0)
     , clusterClock()
     , startElectionAt(TimePoint::max())
     , withholdVotesUntil(TimePoint::min())
     , numEntriesTruncated(0)
-    , leaderDiskThread()
+    , numLeadershipChecks(0)
+    , numLeadershipRounds(0)
+    , numLeaseHits(0)
+    , numLeaseMisses(0)
+    , numReadIndexRequested(0)
+    , numReadIndexFailed(0)
+    , numReadIndexServed(0)
+    , leaderReadSession()
+    , leaderReadSessionServerId(0)
+    , proposalQueue(NULL)
+    , proposalMutex()
+    , proposalAvailable()
+    , proposerExiting(false)
+    , proposerExited(false)
+    , numProposals(0)
+    , numProposalBatches(0)
+    , proposalBatchSize()
+    , proposalBatchSizeHistogram()
+    , proposalQueueNanos()
+    , replyMutex()
+    , replyReady()
+    , readyPeers()
+    , replicationExiting(false)
+    , numReplicationWakeups(0)
+    , numAppendEntriesCompleted(0)
+    , diskThread()
     , timerThread()
     , stepDownThread()
+    , proposerThread()
+    , replicationThreads()
     , invariants(*this)
 {
+    if (LEADER_LEASE >= ELECTION_TIMEOUT) {
+        PANIC("leaderLeaseMilliseconds (%lu) must be less than "
+              "electionTimeoutMilliseconds (%lu)",
+              std::chrono::duration_cast<std::chrono::milliseconds>(
+                  LEADER_LEASE).count(),
+              std::chrono::duration_cast<std::chrono::milliseconds>(
+                  ELECTION_TIMEOUT).count());
+    }
 }
 
 RaftConsensus::~RaftConsensus()
 {
     if (!exiting)
         exit();
-    if (leaderDiskThread.joinable())
-        leaderDiskThread.join();
+    if (diskThread.joinable())
+        diskThread.join();
     if (timerThread.joinable())
         timerThread.join();
     if (stepDownThread.joinable())
         stepDownThread.join();
+    if (proposerThread.joinable())
+        proposerThread.join();
+    for (auto it = replicationThreads.begin();
+         it != replicationThreads.end();
+         ++it) {
+        it->join();
+    }
     NOTICE("Joined with disk and timer threads");
     std::unique_lock<Mutex> lockGuard(mutex);
     if (numPeerThreads > 0) {
@@ -1022,14 +1189,17 @@ RaftConsensus::init()
     for (uint64_t index = log->getLogStartIndex();
          index <= log->getLastLogIndex();
          ++index) {
-        const Log::Entry& entry = log->getEntry(index);
-        if (entry.type() == Protocol::Raft::EntryType::UNKNOWN) {
+        // Only look at the types here, so that logs that don't keep their
+        // entries in memory needn't read every entry back in.
+        Protocol::Raft::EntryType type = log->getEntryType(index);
+        if (type == Protocol::Raft::EntryType::UNKNOWN) {
             PANIC("Don't understand the entry type for index %lu (term %lu) "
                   "found on disk",
-                  index, entry.term());
+                  index, log->getEntryTerm(index));
         }
-        if (entry.type() == Protocol::Raft::EntryType::CONFIGURATION) {
-            configurationManager->add(index, entry.configuration());
+        if (type == Protocol::Raft::EntryType::CONFIGURATION) {
+            configurationManager->add(index,
+                                      log->getEntry(index).configuration());
         }
     }
 
@@ -1057,20 +1227,32 @@ RaftConsensus::init()
     // without PANICing before deleting these files.
     Storage::SnapshotFile::discardPartialSnapshots(storageLayout);
 
+    // Everything read from disk is durable.
+    configuration->localServer->lastSyncedIndex = log->getLastLogIndex();
+
     if (configuration->id == 0)
         NOTICE("No configuration, waiting to receive one.");
 
     stepDown(currentTerm);
     if (RaftConsensusInternal::startThreads) {
-        leaderDiskThread = std::thread(
-            &RaftConsensus::leaderDiskThreadMain, this);
+        diskThread = std::thread(
+            &RaftConsensus::diskThreadMain, this);
         timerThread = std::thread(
             &RaftConsensus::timerThreadMain, this);
         stepDownThread = std::thread(
             &RaftConsensus::stepDownThreadMain, this);
+        if (MAX_PROPOSAL_BATCH_ENTRIES > 0) {
+            proposerThread = std::thread(
+                &RaftConsensus::proposerThreadMain, this);
+        }
+        for (uint64_t i = 0; i < REPLICATION_THREADS; ++i) {
+            replicationThreads.emplace_back(
+                &RaftConsensus::replicationThreadMain, this);
+        }
     }
     // log->path = ""; // hack to disable disk
     stateChanged.notify_all();
+    publishCommitState();
     printElectionState();
 }
 
@@ -1083,6 +1265,16 @@ RaftConsensus::exit()
     if (configuration)
         configuration->forEach(&Server::exit);
     interruptAll();
+    {
+        std::lock_guard<std::mutex> proposalGuard(proposalMutex);
+        proposerExiting = true;
+    }
+    proposalAvailable.notify_all();
+    {
+        std::lock_guard<std::mutex> replyGuard(replyMutex);
+        replicationExiting = true;
+    }
+    replyReady.notify_all();
 }
 
 void
@@ -1140,6 +1332,68 @@ RaftConsensus::getLastCommitIndex() const
         return {ClientResult::SUCCESS, commitIndex};
 }
 
+std::pair<RaftConsensus::ClientResult, uint64_t>
+RaftConsensus::getReadIndexFromLeader()
+{
+    std::unique_lock<Mutex> lockGuard(mutex);
+    if (!FOLLOWER_READS || exiting ||
+        state != State::FOLLOWER || leaderId == 0) {
+        return {ClientResult::NOT_LEADER, 0};
+    }
+    ++numReadIndexRequested;
+    uint64_t leader = leaderId;
+    TimePoint timeout = Clock::now() + ELECTION_TIMEOUT;
+
+    std::shared_ptr<RPC::ClientSession> session = leaderReadSession;
+    if (!session ||
+        leaderReadSessionServerId != leader ||
+        !session->getErrorMessage().empty()) {
+        std::string addresses = configuration->lookupAddress(leader);
+        if (addresses.empty()) {
+            ++numReadIndexFailed;
+            return {ClientResult::NOT_LEADER, 0};
+        }
+        {
+            // release lock for concurrency
+            Core::MutexUnlock<Mutex> unlockGuard(lockGuard);
+            RPC::Address target(addresses, Protocol::Common::DEFAULT_PORT);
+            target.refresh(timeout);
+            Client::SessionManager::ServerId peerId(leader);
+            session = sessionManager.createSession(
+                target,
+                timeout,
+                &globals.clusterUUID,
+                &peerId);
+        }
+        leaderReadSession = session;
+        leaderReadSessionServerId = leader;
+    }
+
+    Protocol::Raft::GetReadIndex::Request request;
+    request.set_server_id(serverId);
+    Protocol::Raft::GetReadIndex::Response response;
+    RPC::ClientRPC rpc(session,
+                       Protocol::Common::ServiceId::RAFT_SERVICE,
+                       /* serviceSpecificErrorVersion = */ 0,
+                       Protocol::Raft::OpCode::GET_READ_INDEX,
+                       request);
+    RPC::ClientRPC::Status status;
+    {
+        // release lock for concurrency
+        Core::MutexUnlock<Mutex> unlockGuard(lockGuard);
+        status = rpc.waitForReply(&response, NULL, timeout);
+    }
+    if (status != RPC::ClientRPC::Status::OK || !response.success()) {
+        ++numReadIndexFailed;
+        if (status == RPC::ClientRPC::Status::RPC_FAILED &&
+            leaderReadSession == session) {
+            leaderReadSession.reset();
+        }
+        return {ClientResult::NOT_LEADER, 0};
+    }
+    return {ClientResult::SUCCESS, response.read_index()};
+}
+
 std::string
 RaftConsensus::getLeaderHint() const
 {
@@ -1149,18 +1403,27 @@ RaftConsensus::getLeaderHint() const
 
 RaftConsensus::Entry
 RaftConsensus::getNextEntry(uint64_t lastIndex) const
+{
+    std::vector<Entry> entries = getNextEntries(lastIndex, 1);
+    return std::move(entries.front());
+}
+
+std::vector<RaftConsensus::Entry>
+RaftConsensus::getNextEntries(uint64_t lastIndex, uint64_t maxEntries) const
 {
     std::unique_lock<Mutex> lockGuard(mutex);
     uint64_t nextIndex = lastIndex + 1;
     while (true) {
         if (exiting)
             throw Core::Util::ThreadInterruptedException();
-        if (commitIndex >= nextIndex) {
-            RaftConsensus::Entry entry;
+        uint64_t lastApplicableIndex = getLastApplicableIndex();
+        if (lastApplicableIndex >= nextIndex) {
+            std::vector<Entry> entries;
 
             // Make the state machine load a snapshot if we don't have the next
             // entry it needs in the log.
             if (log->getLogStartIndex() > nextIndex) {
+                RaftConsensus::Entry entry;
                 entry.type = Entry::SNAPSHOT;
                 // For well-behaved state machines, we expect 'snapshotReader'
                 // to contain a SnapshotFile::Reader that we can return
@@ -1180,25 +1443,42 @@ RaftConsensus::getNextEntry(uint64_t lastIndex) const
                 }
                 entry.index = lastSnapshotIndex;
                 entry.clusterTime = lastSnapshotClusterTime;
-            } else {
-                // not a snapshot
-                const Log::Entry& logEntry = log->getEntry(nextIndex);
-                entry.index = nextIndex;
-                if (logEntry.type() == Protocol::Raft::EntryType::DATA) {
+                // A snapshot is always returned on its own.
+                entries.push_back(std::move(entry));
+                return entries;
+            }
+
+            // not a snapshot
+            uint64_t endIndex = std::min(lastApplicableIndex,
+                                         nextIndex + maxEntries - 1);
+            entries.reserve(endIndex - nextIndex + 1);
+            for (uint64_t index = nextIndex; index <= endIndex; ++index) {
+                RaftConsensus::Entry entry;
+                Log::EntryPtr logEntry = log->getEntryPtr(index);
+                entry.index = index;
+                if (logEntry->type() == Protocol::Raft::EntryType::DATA) {
                     entry.type = Entry::DATA;
-                    const std::string& s = logEntry.data();
-                    entry.command = Core::Buffer(
-                        memcpy(new char[s.length()], s.data(), s.length()),
-                        s.length(),
-                        Core::Buffer::deleteArrayFn<char>);
+                    // Hand the state machine the log's own copy of the data:
+                    // entries are immutable once in the log, and holding
+                    // 'logEntry' keeps this one alive after it's discarded.
+                    const std::string& s = logEntry->data();
+                    entry.command = Core::Buffer(const_cast<char*>(s.data()),
+                                                 s.length(),
+                                                 NULL);
+                    entry.logEntry = logEntry;
                 } else {
                     entry.type = Entry::SKIP;
                 }
-                entry.clusterTime = logEntry.cluster_time();
+                entry.clusterTime = logEntry->cluster_time();
+                entries.push_back(std::move(entry));
             }
-            return entry;
+            return entries;
         }
-        stateChanged.wait(lockGuard);
+        // Wait without the Raft lock; see commitMutex.
+        Core::MutexUnlock<Mutex> unlockGuard(lockGuard);
+        std::unique_lock<std::mutex> commitGuard(commitMutex);
+        while (!publishedExiting && publishedApplicableIndex < nextIndex)
+            commitChanged.wait(commitGuard);
     }
 }
 
@@ -1219,10 +1499,10 @@ RaftConsensus::getSnapshotStats() const
 
 void
 RaftConsensus::handleAppendEntries(
-                    const Protocol::Raft::AppendEntries::Request& request,
+                    Protocol::Raft::AppendEntries::Request& request,
                     Protocol::Raft::AppendEntries::Response& response)
 {
-    std::lock_guard<Mutex> lockGuard(mutex);
+    std::unique_lock<Mutex> lockGuard(mutex);
     assert(!exiting);
 
     // Set response to a rejection. We'll overwrite these later if we end up
@@ -1272,9 +1552,19 @@ RaftConsensus::handleAppendEntries(
     // We could truncate the log here, but there's no real advantage to doing
     // that.
     if (request.prev_log_index() >= log->getLogStartIndex() &&
-        log->getEntry(request.prev_log_index()).term() !=
+        log->getEntryTerm(request.prev_log_index()) !=
             request.prev_log_term()) {
         VERBOSE("Rejecting AppendEntries RPC: terms don't agree");
+        // Tell the leader where our conflicting term begins, so it can skip
+        // all of it at once.
+        uint64_t conflictTerm = log->getEntryTerm(request.prev_log_index());
+        uint64_t conflictIndex = request.prev_log_index();
+        while (conflictIndex > log->getLogStartIndex() &&
+               log->getEntryTerm(conflictIndex - 1) == conflictTerm) {
+            --conflictIndex;
+        }
+        response.set_conflict_term(conflictTerm);
+        response.set_conflict_index(conflictIndex);
         return; // response was set to a rejection above
     }
 
@@ -1298,8 +1588,8 @@ RaftConsensus::handleAppendEntries(
     // on the follower's disk between the truncate and append operations (which
     // are not done atomically) when the follower processes the later request.
     uint64_t index = request.prev_log_index();
-    for (auto it = request.entries().begin();
-         it != request.entries().end();
+    for (auto it = request.mutable_entries()->begin();
+         it != request.mutable_entries()->end();
          ++it) {
         ++index;
         const Protocol::Raft::Entry& entry = *it;
@@ -1314,7 +1604,7 @@ RaftConsensus::handleAppendEntries(
             continue;
         }
         if (log->getLastLogIndex() >= index) {
-            if (log->getEntry(index).term() == entry.term())
+            if (log->getEntryTerm(index) == entry.term())
                 continue;
             // should never truncate committed entries:
             assert(commitIndex < index);
@@ -1324,14 +1614,25 @@ RaftConsensus::handleAppendEntries(
                    numTruncating,
                    lastIndexKept);
             numEntriesTruncated += numTruncating;
+            // Followers defer their log syncs to the disk thread, so the
+            // log may still hold writes and renames for the entries being
+            // removed. Those must reach the disk before truncateSuffix()
+            // rewrites the files underneath them.
+            syncLogNow();
             log->truncateSuffix(lastIndexKept);
             configurationManager->truncateSuffix(lastIndexKept);
+            // A sync the disk thread is working on may cover the entries
+            // that were just removed; don't let it count for the new ones.
+            ++logSyncGeneration;
+            LocalServer& localServer = *configuration->localServer;
+            if (localServer.lastSyncedIndex > lastIndexKept)
+                localServer.lastSyncedIndex = lastIndexKept;
         }
 
         // Append this and all following entries.
-        std::vector<const Protocol::Raft::Entry*> entries;
+        std::vector<Log::EntryPtr> entries;
         do {
-            const Protocol::Raft::Entry& entry = *it;
+            Protocol::Raft::Entry& entry = *it;
             if (entry.type() == Protocol::Raft::EntryType::UNKNOWN) {
                 PANIC("Leader %lu is trying to send us an unknown log entry "
                       "type for index %lu (term %lu). It shouldn't do that, "
@@ -1342,10 +1643,15 @@ RaftConsensus::handleAppendEntries(
                       entry.term(),
                       leaderId);
             }
-            entries.push_back(&entry);
+            // Take the entry out of the request rather than copying it; only
+            // the number of entries is used after this.
+            std::shared_ptr<Log::Entry> shared =
+                std::make_shared<Log::Entry>();
+            shared->Swap(&entry);
+            entries.push_back(std::move(shared));
             ++it;
             ++index;
-        } while (it != request.entries().end());
+        } while (it != request.mutable_entries()->end());
         append(entries);
         clusterClock.newEpoch(entries.back()->cluster_time());
         break;
@@ -1361,8 +1667,26 @@ RaftConsensus::handleAppendEntries(
         commitIndex = request.commit_index();
         assert(commitIndex <= log->getLastLogIndex());
         stateChanged.notify_all();
+        publishCommitState();
         VERBOSE("New commitIndex: %lu", commitIndex);
     }
+
+    // Only acknowledge entries once they're durable. With asyncFollowerSync,
+    // the disk thread flushes them while this waits without holding the lock.
+    // Give up if anything changed underneath (the leader will retry).
+    uint64_t lastNewIndex = request.prev_log_index() +
+                            uint64_t(request.entries_size());
+    uint64_t term = currentTerm;
+    uint64_t generation = logSyncGeneration;
+    while (configuration->localServer->lastSyncedIndex < lastNewIndex) {
+        if (exiting ||
+            currentTerm != term ||
+            logSyncGeneration != generation) {
+            response.set_success(false);
+            break;
+        }
+        stateChanged.wait(lockGuard);
+    }
 }
 
 void
@@ -1461,6 +1785,24 @@ RaftConsensus::handleInstallSnapshot(
     }
 }
 
+void
+RaftConsensus::handleGetReadIndex(
+        const Protocol::Raft::GetReadIndex::Request& request,
+        Protocol::Raft::GetReadIndex::Response& response)
+{
+    std::pair<ClientResult, uint64_t> result = getLastCommitIndex();
+    std::lock_guard<Mutex> lockGuard(mutex);
+    if (result.first == ClientResult::SUCCESS) {
+        ++numReadIndexServed;
+        response.set_success(true);
+        response.set_read_index(result.second);
+    } else {
+        VERBOSE("Refusing read index to server %lu: not leader",
+                request.server_id());
+        response.set_success(false);
+    }
+}
+
 void
 RaftConsensus::handleRequestVote(
                     const Protocol::Raft::RequestVote::Request& request,
@@ -1523,11 +1865,41 @@ RaftConsensus::handleRequestVote(
 std::pair<RaftConsensus::ClientResult, uint64_t>
 RaftConsensus::replicate(const Core::Buffer& operation)
 {
-    std::unique_lock<Mutex> lockGuard(mutex);
-    Log::Entry entry;
-    entry.set_type(Protocol::Raft::EntryType::DATA);
-    entry.set_data(operation.getData(), operation.getLength());
-    return replicateEntry(entry, lockGuard);
+    if (!proposerThread.joinable()) {
+        std::unique_lock<Mutex> lockGuard(mutex);
+        Log::Entry entry;
+        entry.set_type(Protocol::Raft::EntryType::DATA);
+        entry.set_data(operation.getData(), operation.getLength());
+        return replicateEntry(entry, lockGuard);
+    }
+
+    // Queue the operation for the proposer without taking any lock, and only
+    // wake it up if it might be asleep on an empty queue.
+    Proposal proposal(operation);
+    Proposal* head = proposalQueue.load();
+    do {
+        proposal.next = head;
+    } while (!proposalQueue.compare_exchange_weak(head, &proposal));
+    if (head == NULL) {
+        std::lock_guard<std::mutex> proposalGuard(proposalMutex);
+        proposalAvailable.notify_one();
+    }
+
+    // Everything this waits on is published under commitMutex, so this
+    // thread never needs the Raft lock.
+    std::unique_lock<std::mutex> commitGuard(commitMutex);
+    while (!proposal.done && !proposerExited)
+        commitChanged.wait(commitGuard);
+    if (!proposal.done || proposal.index == 0)
+        return {ClientResult::NOT_LEADER, 0};
+    while (!publishedExiting && publishedTerm == proposal.term) {
+        if (publishedCommitIndex >= proposal.index) {
+            VERBOSE("replicate succeeded");
+            return {ClientResult::SUCCESS, proposal.index};
+        }
+        commitChanged.wait(commitGuard);
+    }
+    return {ClientResult::NOT_LEADER, 0};
 }
 
 RaftConsensus::ClientResult
@@ -1817,6 +2189,27 @@ RaftConsensus::updateServerStats(Protocol::ServerStats& serverStats) const
     raftStats.set_last_snapshot_cluster_time(lastSnapshotClusterTime);
     raftStats.set_last_snapshot_bytes(lastSnapshotBytes);
     raftStats.set_num_entries_truncated(numEntriesTruncated);
+    raftStats.set_num_leadership_checks(numLeadershipChecks);
+    raftStats.set_num_leadership_rounds(numLeadershipRounds);
+    raftStats.set_num_read_index_requested(numReadIndexRequested);
+    raftStats.set_num_read_index_failed(numReadIndexFailed);
+    raftStats.set_num_read_index_served(numReadIndexServed);
+    raftStats.set_num_proposals(numProposals);
+    raftStats.set_num_proposal_batches(numProposalBatches);
+    proposalBatchSize.updateProtoBuf(
+        *raftStats.mutable_proposal_batch_size());
+    for (auto it = proposalBatchSizeHistogram.begin();
+         it != proposalBatchSizeHistogram.end();
+         ++it) {
+        raftStats.add_proposal_batch_size_histogram(*it);
+    }
+    proposalQueueNanos.updateProtoBuf(
+        *raftStats.mutable_proposal_queue_nanos());
+    raftStats.set_num_replication_wakeups(numReplicationWakeups);
+    raftStats.set_num_append_entries_completed(numAppendEntriesCompleted);
+    raftStats.set_num_lease_hits(numLeaseHits);
+    raftStats.set_num_lease_misses(numLeaseMisses);
+    raftStats.set_lease_remaining_nanos(uint64_t(getLeaseRemaining().count()));
     raftStats.set_log_start_index(log->getLogStartIndex());
     raftStats.set_log_bytes(log->getSizeBytes());
     configuration->updateServerStats(serverStats, time);
@@ -1860,29 +2253,39 @@ operator<<(std::ostream& os, const RaftConsensus& raft)
 //// RaftConsensus private methods that MUST acquire the lock
 
 void
-RaftConsensus::leaderDiskThreadMain()
+RaftConsensus::diskThreadMain()
 {
     std::unique_lock<Mutex> lockGuard(mutex);
-    Core::ThreadId::setName("LeaderDisk");
+    Core::ThreadId::setName("Disk");
     // Each iteration of this loop syncs the log to disk once or sleeps until
     // that is necessary.
     while (!exiting) {
-        if (state == State::LEADER && logSyncQueued) {
+        if (logSyncQueued) {
             uint64_t term = currentTerm;
+            uint64_t generation = logSyncGeneration;
             std::unique_ptr<Log::Sync> sync = log->takeSync();
             logSyncQueued = false;
-            leaderDiskThreadWorking = true;
+            diskThreadWorking = true;
             {
                 Core::MutexUnlock<Mutex> unlockGuard(lockGuard);
                 sync->wait();
                 // Mark this false before re-acquiring RaftConsensus lock,
                 // since stepDown() polls on this to go false while holding the
                 // lock.
-                leaderDiskThreadWorking = false;
+                diskThreadWorking = false;
             }
-            if (state == State::LEADER && currentTerm == term) {
-                configuration->localServer->lastSyncedIndex = sync->lastIndex;
-                advanceCommitIndex();
+            if (logSyncGeneration == generation) {
+                if (state == State::LEADER && currentTerm == term) {
+                    configuration->localServer->lastSyncedIndex =
+                        sync->lastIndex;
+                    advanceCommitIndex();
+                } else if (state == State::FOLLOWER) {
+                    configuration->localServer->lastSyncedIndex =
+                        sync->lastIndex;
+                    stateChanged.notify_all();
+                    // Committed entries may now be applied.
+                    publishCommitState();
+                }
             }
             log->syncComplete(std::move(sync));
             continue;
@@ -1919,6 +2322,11 @@ RaftConsensus::peerThreadMain(std::shared_ptr<Peer> peer)
 
         if (peer->backoffUntil > now) {
             waitUntil = peer->backoffUntil;
+        } else if (peer->pendingRPC) {
+            // A RequestVote or InstallSnapshot request is outstanding. The
+            // replication threads will process its response and notify
+            // stateChanged.
+            waitUntil = TimePoint::max();
         } else {
             switch (state) {
                 // Followers don't issue RPCs.
@@ -1936,8 +2344,18 @@ RaftConsensus::peerThreadMain(std::shared_ptr<Peer> peer)
 
                 // Leaders replicate entries and periodically send heartbeats.
                 case State::LEADER:
-                    if (peer->getMatchIndex() < log->getLastLogIndex() ||
-                        peer->nextHeartbeatTime < now) {
+                    if (!peer->appendEntriesInFlight.empty()) {
+                        // Keep the pipeline full while there are new entries
+                        // to send. Anything else (heartbeats, probes, and
+                        // requests that might need a snapshot instead) waits
+                        // until the outstanding requests have completed.
+                        if (canPipelineAppendEntries(*peer)) {
+                            appendEntries(lockGuard, *peer);
+                        } else {
+                            waitUntil = TimePoint::max();
+                        }
+                    } else if (peer->getMatchIndex() < log->getLastLogIndex() ||
+                               peer->nextHeartbeatTime < now) {
                         // appendEntries delegates to installSnapshot if we
                         // need to send a snapshot instead
                         appendEntries(lockGuard, *peer);
@@ -1957,6 +2375,143 @@ RaftConsensus::peerThreadMain(std::shared_ptr<Peer> peer)
     NOTICE("Peer thread for server %lu exiting", peer->serverId);
 }
 
+void
+RaftConsensus::replicationThreadMain()
+{
+    Core::ThreadId::setName("replication");
+    while (true) {
+        std::deque<std::weak_ptr<Peer>> peers;
+        {
+            std::unique_lock<std::mutex> replyGuard(replyMutex);
+            while (!replicationExiting && readyPeers.empty())
+                replyReady.wait(replyGuard);
+            if (replicationExiting)
+                break;
+            // Take every ready peer at once, so that a burst of responses
+            // costs one acquisition of the Raft lock.
+            peers.swap(readyPeers);
+        }
+        // Declared before lockGuard so that if these hold the last reference
+        // to a peer, it's destroyed after the lock is released.
+        std::vector<std::shared_ptr<Peer>> live;
+        std::unique_lock<Mutex> lockGuard(mutex);
+        ++numReplicationWakeups;
+        for (auto it = peers.begin(); it != peers.end(); ++it) {
+            std::shared_ptr<Peer> peer = it->lock();
+            if (!peer)
+                continue;
+            live.push_back(peer);
+            processPendingReply(lockGuard, *peer);
+            processAppendEntriesReplies(lockGuard, *peer);
+        }
+    }
+    NOTICE("Replication thread exiting");
+}
+
+void
+RaftConsensus::queueReplicationWork(std::weak_ptr<Peer> peer)
+{
+    {
+        std::lock_guard<std::mutex> replyGuard(replyMutex);
+        readyPeers.push_back(std::move(peer));
+    }
+    replyReady.notify_one();
+}
+
+void
+RaftConsensus::proposerThreadMain()
+{
+    Core::ThreadId::setName("proposer");
+    // Proposals taken off the queue but not yet appended, oldest first.
+    std::deque<Proposal*> pending;
+    // Move everything in proposalQueue onto the end of 'pending'.
+    auto drain = [this, &pending]() {
+        Proposal* head = proposalQueue.exchange(NULL);
+        std::deque<Proposal*> newest;
+        for (; head != NULL; head = head->next)
+            newest.push_front(head);
+        pending.insert(pending.end(), newest.begin(), newest.end());
+    };
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> proposalGuard(proposalMutex);
+            while (!proposerExiting && pending.empty() &&
+                   proposalQueue.load() == NULL) {
+                proposalAvailable.wait(proposalGuard);
+            }
+            if (proposerExiting)
+                break;
+        }
+        drain();
+        if (PROPOSAL_BATCH_DELAY > std::chrono::nanoseconds::zero() &&
+            pending.size() < MAX_PROPOSAL_BATCH_ENTRIES) {
+            // Give more operations a chance to join this batch.
+            std::this_thread::sleep_until(
+                pending.front()->enqueued + PROPOSAL_BATCH_DELAY);
+            drain();
+        }
+
+        uint64_t batchSize = std::min(uint64_t(pending.size()),
+                                      MAX_PROPOSAL_BATCH_ENTRIES);
+        std::vector<Log::EntryPtr> entries;
+        entries.reserve(batchSize);
+        TimePoint now = Clock::now();
+
+        std::lock_guard<Mutex> lockGuard(mutex);
+        if (state == State::LEADER) {
+            uint64_t clusterTime = clusterClock.leaderStamp();
+            uint64_t nextIndex = log->getLastLogIndex() + 1;
+            for (uint64_t i = 0; i < batchSize; ++i) {
+                const Core::Buffer& operation = pending.at(i)->operation;
+                std::shared_ptr<Log::Entry> entry =
+                    std::make_shared<Log::Entry>();
+                entry->set_term(currentTerm);
+                entry->set_type(Protocol::Raft::EntryType::DATA);
+                entry->set_index(nextIndex + i);
+                entry->set_data(operation.getData(), operation.getLength());
+                entry->set_cluster_time(clusterTime);
+                entries.push_back(std::move(entry));
+            }
+            append(entries);
+            uint64_t index = log->getLastLogIndex() - batchSize + 1;
+            for (uint64_t i = 0; i < batchSize; ++i) {
+                Proposal& proposal = *pending.at(i);
+                proposalQueueNanos.push(uint64_t(
+                    std::chrono::nanoseconds(now - proposal.enqueued).count()));
+                proposal.term = currentTerm;
+                proposal.index = index + i;
+            }
+            ++numProposalBatches;
+            numProposals += batchSize;
+            proposalBatchSize.push(batchSize);
+            uint64_t bucket = 0;
+            while ((batchSize >> (bucket + 1)) > 0)
+                ++bucket;
+            if (proposalBatchSizeHistogram.size() <= bucket)
+                proposalBatchSizeHistogram.resize(bucket + 1);
+            ++proposalBatchSizeHistogram.at(bucket);
+        }
+        // Proposals are rejected (index 0) if this server isn't leader.
+        std::lock_guard<std::mutex> commitGuard(commitMutex);
+        for (uint64_t i = 0; i < batchSize; ++i) {
+            pending.front()->done = true;
+            pending.pop_front();
+        }
+        commitChanged.notify_all();
+    }
+
+    // Reject everything still queued; callers waiting on these see
+    // proposerExited and give up.
+    std::lock_guard<Mutex> lockGuard(mutex);
+    drain();
+    std::lock_guard<std::mutex> commitGuard(commitMutex);
+    for (auto it = pending.begin(); it != pending.end(); ++it)
+        (*it)->done = true;
+    proposerExited = true;
+    commitChanged.notify_all();
+}
+
 void
 RaftConsensus::stepDownThreadMain()
 {
@@ -2028,12 +2583,13 @@ RaftConsensus::advanceCommitIndex()
     assert(newCommitIndex >= log->getLogStartIndex());
     // At least one of these entries must also be from the current term to
     // guarantee that no server without them can be elected.
-    if (log->getEntry(newCommitIndex).term() != currentTerm)
+    if (log->getEntryTerm(newCommitIndex) != currentTerm)
         return;
     commitIndex = newCommitIndex;
     VERBOSE("New commitIndex: %lu", commitIndex);
     assert(commitIndex <= log->getLastLogIndex());
     stateChanged.notify_all();
+    publishCommitState();
 
     if (state == State::LEADER && commitIndex >= configuration->id) {
         // Upon committing a configuration that excludes itself, the leader
@@ -2062,16 +2618,32 @@ RaftConsensus::advanceCommitIndex()
 
 void
 RaftConsensus::append(const std::vector<const Log::Entry*>& entries)
+{
+    std::vector<Log::EntryPtr> copies;
+    copies.reserve(entries.size());
+    uint64_t index = log->getLastLogIndex() + 1;
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        std::shared_ptr<Log::Entry> copy = std::make_shared<Log::Entry>(**it);
+        copy->set_index(index);
+        ++index;
+        copies.push_back(std::move(copy));
+    }
+    append(copies);
+}
+
+void
+RaftConsensus::append(const std::vector<Log::EntryPtr>& entries)
 {
     for (auto it = entries.begin(); it != entries.end(); ++it)
         assert((*it)->term() != 0);
     std::pair<uint64_t, uint64_t> range = log->append(entries);
-    if (state == State::LEADER) { // defer log sync
+    if (state == State::LEADER ||
+        (state == State::FOLLOWER && ASYNC_FOLLOWER_SYNC &&
+         diskThread.joinable())) {
+        // defer log sync
         logSyncQueued = true;
     } else { // sync log now
-        std::unique_ptr<Log::Sync> sync = log->takeSync();
-        sync->wait();
-        log->syncComplete(std::move(sync));
+        syncLogNow();
     }
     uint64_t index = range.first;
     for (auto it = entries.begin(); it != entries.end(); ++it) {
@@ -2100,7 +2672,7 @@ RaftConsensus::appendEntries(std::unique_lock<Mutex>& lockGuard,
     // Find prevLogTerm or fall back to sending a snapshot.
     uint64_t prevLogTerm;
     if (prevLogIndex >= log->getLogStartIndex()) {
-        prevLogTerm = log->getEntry(prevLogIndex).term();
+        prevLogTerm = log->getEntryTerm(prevLogIndex);
     } else if (prevLogIndex == 0) {
         prevLogTerm = 0;
     } else if (prevLogIndex == lastSnapshotIndex) {
@@ -2118,24 +2690,54 @@ RaftConsensus::appendEntries(std::unique_lock<Mutex>& lockGuard,
     request.set_prev_log_term(prevLogTerm);
     request.set_prev_log_index(prevLogIndex);
     uint64_t numEntries = 0;
+    LentEntries lent(request);
     if (!peer.suppressBulkData)
-        numEntries = packEntries(peer.nextIndex, request);
+        numEntries = packEntries(peer.nextIndex, request, lent);
     request.set_commit_index(std::min(commitIndex, prevLogIndex + numEntries));
 
     // Execute RPC
-    Protocol::Raft::AppendEntries::Response response;
-    TimePoint start = Clock::now();
     uint64_t epoch = currentEpoch;
-    Peer::CallStatus status = peer.callRPC(
-                Protocol::Raft::OpCode::APPEND_ENTRIES,
-                request, response,
-                lockGuard);
+    lastEpochSent = epoch;
+    Peer::AppendEntriesRPC sent(currentTerm, prevLogIndex, numEntries,
+                                epoch, Clock::now());
+    // Leave the response to the replication threads and assume the request
+    // will succeed, so that the next one can go out right away.
+    sent.rpc = peer.startRPC(Protocol::Raft::OpCode::APPEND_ENTRIES,
+                             request,
+                             lockGuard);
+    if (currentTerm == sent.term)
+        peer.nextIndex = prevLogIndex + numEntries + 1;
+    peer.appendEntriesInFlight.push_back(std::move(sent));
+    // Set the callback only once the request is in appendEntriesInFlight,
+    // since it may run right away.
+    std::weak_ptr<Peer> weakPeer = peer.weakSelf;
+    peer.appendEntriesInFlight.back().rpc.setCallback(
+        [this, weakPeer]() { queueReplicationWork(weakPeer); });
+    stateChanged.notify_all();
+}
+
+void
+RaftConsensus::appendEntriesDone(
+        Peer& peer,
+        const Peer::AppendEntriesRPC& sent,
+        Peer::CallStatus status,
+        const Protocol::Raft::AppendEntries::Response& response)
+{
+    uint64_t prevLogIndex = sent.prevLogIndex;
+    uint64_t numEntries = sent.numEntries;
     switch (status) {
         case Peer::CallStatus::OK:
             break;
         case Peer::CallStatus::FAILED:
             peer.suppressBulkData = true;
-            peer.backoffUntil = start + RPC_FAILURE_BACKOFF;
+            peer.backoffUntil = sent.start + RPC_FAILURE_BACKOFF;
+            // Resend whatever this request carried (and anything pipelined
+            // after it), but nothing the peer has already acknowledged.
+            if (currentTerm == sent.term &&
+                peer.nextIndex > prevLogIndex + 1) {
+                peer.nextIndex = std::max(prevLogIndex + 1,
+                                          peer.matchIndex + 1);
+            }
             return;
         case Peer::CallStatus::INVALID_REQUEST:
             PANIC("The server's RaftService doesn't support the AppendEntries "
@@ -2144,7 +2746,7 @@ RaftConsensus::appendEntries(std::unique_lock<Mutex>& lockGuard,
 
     // Process response
 
-    if (currentTerm != request.term() || peer.exiting) {
+    if (currentTerm != sent.term || peer.exiting) {
         // we don't care about result of RPC
         return;
     }
@@ -2158,21 +2760,22 @@ RaftConsensus::appendEntries(std::unique_lock<Mutex>& lockGuard,
         stepDown(response.term());
     } else {
         assert(response.term() == currentTerm);
-        peer.lastAckEpoch = epoch;
+        peer.lastAckEpoch = std::max(peer.lastAckEpoch, sent.epoch);
+        peer.lastAckSentNanos = std::max(
+            peer.lastAckSentNanos,
+            uint64_t(sent.start.time_since_epoch().count()));
         stateChanged.notify_all();
-        peer.nextHeartbeatTime = start + HEARTBEAT_PERIOD;
+        peer.nextHeartbeatTime = sent.start + HEARTBEAT_PERIOD;
         if (response.success()) {
-            if (peer.matchIndex > prevLogIndex + numEntries) {
-                // Revisit this warning if we pipeline AppendEntries RPCs for
-                // performance.
-                WARNING("matchIndex should monotonically increase within a "
-                        "term, since servers don't forget entries. But it "
-                        "didn't.");
-            } else {
+            // With pipelining, this may acknowledge less than an earlier
+            // response did (for example, a heartbeat sent before a batch of
+            // entries). Servers don't forget entries within a term, so
+            // matchIndex only moves forwards.
+            if (peer.matchIndex <= prevLogIndex + numEntries) {
                 peer.matchIndex = prevLogIndex + numEntries;
                 advanceCommitIndex();
             }
-            peer.nextIndex = peer.matchIndex + 1;
+            peer.nextIndex = std::max(peer.nextIndex, peer.matchIndex + 1);
             peer.suppressBulkData = false;
 
             if (!peer.isCaughtUp_ &&
@@ -2193,9 +2796,46 @@ RaftConsensus::appendEntries(std::unique_lock<Mutex>& lockGuard,
                     peer.thisCatchUpIterationGoalId = log->getLastLogIndex();
                 }
             }
+        } else if (appendEntriesInFlightBefore(peer, prevLogIndex)) {
+            // The follower handles pipelined requests concurrently, so this
+            // one may have overtaken an earlier request that is still in
+            // flight and that would have filled in (or overwritten) the
+            // entries before prevLogIndex. The rejection then says nothing
+            // about the follower's log: just resend this request's entries.
+            // If the earlier request is rejected too, that rejection backs
+            // nextIndex up.
+            if (peer.nextIndex > prevLogIndex + 1) {
+                peer.nextIndex = std::max(prevLogIndex + 1,
+                                          peer.matchIndex + 1);
+            }
         } else {
-            if (peer.nextIndex > 1)
-                --peer.nextIndex;
+            // Back up to just before the rejected request. Requests pipelined
+            // after it will be rejected too, but they don't move nextIndex
+            // any further.
+            if (peer.nextIndex > prevLogIndex)
+                peer.nextIndex = std::max(prevLogIndex, uint64_t(1));
+            // If the follower told us which term conflicts, skip that whole
+            // term rather than one entry per round trip: resume right after
+            // our own last entry of that term if we have one, or at the
+            // follower's first entry of that term otherwise.
+            if (response.has_conflict_term()) {
+                uint64_t conflictTerm = response.conflict_term();
+                uint64_t index = std::min(prevLogIndex,
+                                          log->getLastLogIndex());
+                while (index >= log->getLogStartIndex() && index > 0 &&
+                       log->getEntryTerm(index) > conflictTerm) {
+                    --index;
+                }
+                uint64_t hint;
+                if (index >= log->getLogStartIndex() && index > 0 &&
+                    log->getEntryTerm(index) == conflictTerm) {
+                    hint = index + 1;
+                } else {
+                    hint = response.conflict_index();
+                }
+                if (peer.nextIndex > hint)
+                    peer.nextIndex = std::max(hint, peer.matchIndex + 1);
+            }
             // A server that hasn't been around for a while might have a much
             // shorter log than ours. The AppendEntries reply contains the
             // index of its last log entry, and there's no reason for us to
@@ -2205,10 +2845,112 @@ RaftConsensus::appendEntries(std::unique_lock<Mutex>& lockGuard,
                 peer.nextIndex > response.last_log_index() + 1) {
                 peer.nextIndex = response.last_log_index() + 1;
             }
+            // Never resend entries the follower has already acknowledged:
+            // servers don't forget entries within a term.
+            peer.nextIndex = std::max(peer.nextIndex, peer.matchIndex + 1);
         }
     }
 }
 
+bool
+RaftConsensus::appendEntriesInFlightBefore(const Peer& peer,
+                                           uint64_t prevLogIndex) const
+{
+    for (auto it = peer.appendEntriesInFlight.begin();
+         it != peer.appendEntriesInFlight.end();
+         ++it) {
+        if (it->term == currentTerm && it->prevLogIndex < prevLogIndex)
+            return true;
+    }
+    return false;
+}
+
+bool
+RaftConsensus::canPipelineAppendEntries(const Peer& peer) const
+{
+    return (state == State::LEADER &&
+            !peer.exiting &&
+            !peer.appendEntriesInFlight.empty() &&
+            peer.appendEntriesInFlight.size() < MAX_APPEND_ENTRIES_IN_FLIGHT &&
+            !peer.suppressBulkData &&
+            peer.nextIndex <= log->getLastLogIndex() &&
+            peer.nextIndex > log->getLogStartIndex());
+}
+
+void
+RaftConsensus::processAppendEntriesReplies(std::unique_lock<Mutex>& lockGuard,
+                                           Peer& peer)
+{
+    // The follower's RaftService handles requests on many threads, so
+    // responses may complete in any order. Process every one that's ready;
+    // the callbacks of the others will queue the peer again. Each request is
+    // taken out of the window before it's processed, so that
+    // appendEntriesDone() sees only the requests still outstanding.
+    bool progress = false;
+    auto it = peer.appendEntriesInFlight.begin();
+    while (it != peer.appendEntriesInFlight.end()) {
+        if (!it->rpc.isReady()) {
+            ++it;
+            continue;
+        }
+        Peer::AppendEntriesRPC sent(std::move(*it));
+        it = peer.appendEntriesInFlight.erase(it);
+        Protocol::Raft::AppendEntries::Response response;
+        Peer::CallStatus status = peer.decodeReply(sent.rpc, response);
+        appendEntriesDone(peer, sent, status, response);
+        ++numAppendEntriesCompleted;
+        progress = true;
+    }
+    if (!progress)
+        return;
+    // Refill the window from here rather than waking the peer thread for
+    // each response. Whatever can't be pipelined (heartbeats, probes,
+    // snapshots) is left to the peer thread once the window drains.
+    while (canPipelineAppendEntries(peer))
+        appendEntries(lockGuard, peer);
+    stateChanged.notify_all();
+}
+
+void
+RaftConsensus::processPendingReply(std::unique_lock<Mutex>& lockGuard,
+                                   Peer& peer)
+{
+    if (!peer.pendingRPC || !peer.pendingRPC->rpc.isReady())
+        return;
+    std::unique_ptr<Peer::PendingRPC> sent(std::move(peer.pendingRPC));
+    switch (sent->opCode) {
+        case Protocol::Raft::OpCode::REQUEST_VOTE: {
+            Protocol::Raft::RequestVote::Response response;
+            Peer::CallStatus status = peer.decodeReply(sent->rpc, response);
+            requestVoteDone(peer, *sent, status, response);
+            break;
+        }
+        case Protocol::Raft::OpCode::INSTALL_SNAPSHOT: {
+            Protocol::Raft::InstallSnapshot::Response response;
+            Peer::CallStatus status = peer.decodeReply(sent->rpc, response);
+            installSnapshotDone(peer, *sent, status, response);
+            break;
+        }
+        default:
+            PANIC("Unexpected pending RPC opcode %d", int(sent->opCode));
+    }
+    // Wake the peer thread, which sends nothing while pendingRPC is set.
+    stateChanged.notify_all();
+}
+
+void
+RaftConsensus::sendPendingRPC(Peer& peer,
+                              std::unique_ptr<Peer::PendingRPC> sent)
+{
+    assert(!peer.pendingRPC);
+    peer.pendingRPC = std::move(sent);
+    // Set the callback only once the request is in pendingRPC, since it may
+    // run right away.
+    std::weak_ptr<Peer> weakPeer = peer.weakSelf;
+    peer.pendingRPC->rpc.setCallback(
+        [this, weakPeer]() { queueReplicationWork(weakPeer); });
+}
+
 void
 RaftConsensus::installSnapshot(std::unique_lock<Mutex>& lockGuard,
                                Peer& peer)
@@ -2250,13 +2992,27 @@ RaftConsensus::installSnapshot(std::unique_lock<Mutex>& lockGuard,
                      peer.snapshotFile->getFileLength());
 
     // Execute RPC
-    Protocol::Raft::InstallSnapshot::Response response;
-    TimePoint start = Clock::now();
     uint64_t epoch = currentEpoch;
-    Peer::CallStatus status = peer.callRPC(
-                Protocol::Raft::OpCode::INSTALL_SNAPSHOT,
-                request, response,
-                lockGuard);
+    lastEpochSent = epoch;
+    std::unique_ptr<Peer::PendingRPC> sent(new Peer::PendingRPC(
+        Protocol::Raft::OpCode::INSTALL_SNAPSHOT,
+        currentTerm, epoch, Clock::now(), numDataBytes));
+    sent->rpc = peer.startRPC(Protocol::Raft::OpCode::INSTALL_SNAPSHOT,
+                              request,
+                              lockGuard);
+    sendPendingRPC(peer, std::move(sent));
+}
+
+void
+RaftConsensus::installSnapshotDone(
+        Peer& peer,
+        const Peer::PendingRPC& sent,
+        Peer::CallStatus status,
+        const Protocol::Raft::InstallSnapshot::Response& response)
+{
+    TimePoint start = sent.start;
+    uint64_t epoch = sent.epoch;
+    uint64_t numDataBytes = sent.numDataBytes;
     switch (status) {
         case Peer::CallStatus::OK:
             break;
@@ -2271,7 +3027,7 @@ RaftConsensus::installSnapshot(std::unique_lock<Mutex>& lockGuard,
 
     // Process response
 
-    if (currentTerm != request.term() || peer.exiting) {
+    if (currentTerm != sent.term || peer.exiting) {
         // we don't care about result of RPC
         return;
     }
@@ -2286,6 +3042,7 @@ RaftConsensus::installSnapshot(std::unique_lock<Mutex>& lockGuard,
     } else {
         assert(response.term() == currentTerm);
         peer.lastAckEpoch = epoch;
+        peer.lastAckSentNanos = uint64_t(start.time_since_epoch().count());
         stateChanged.notify_all();
         peer.nextHeartbeatTime = start + HEARTBEAT_PERIOD;
         peer.suppressBulkData = false;
@@ -2362,22 +3119,58 @@ RaftConsensus::discardUnneededEntries()
         log->truncatePrefix(lastSnapshotIndex + 1);
         configurationManager->truncatePrefix(lastSnapshotIndex + 1);
         stateChanged.notify_all();
-        if (state == State::LEADER) { // defer log sync
+        if (state == State::LEADER ||
+            (state == State::FOLLOWER && ASYNC_FOLLOWER_SYNC &&
+         diskThread.joinable())) {
+            // defer log sync
             logSyncQueued = true;
         } else { // sync log now
-            std::unique_ptr<Log::Sync> sync = log->takeSync();
-            sync->wait();
-            log->syncComplete(std::move(sync));
+            syncLogNow();
         }
     }
 }
 
+void
+RaftConsensus::syncLogNow()
+{
+    // If the disk thread is currently writing to disk, wait for it to
+    // finish. We poll here because we don't want to release the lock (this
+    // server would then believe its writes have been flushed when they
+    // haven't).
+    while (diskThreadWorking)
+        usleep(500);
+
+    // Flush anything else that has been written to the log. Do this after
+    // waiting for diskThread to preserve FIFO ordering of Log::Sync objects.
+    std::unique_ptr<Log::Sync> sync = log->takeSync();
+    sync->wait();
+    log->syncComplete(std::move(sync));
+    logSyncQueued = false;
+    ++logSyncGeneration;
+    configuration->localServer->lastSyncedIndex = log->getLastLogIndex();
+    stateChanged.notify_all();
+    publishCommitState();
+}
+
+uint64_t
+RaftConsensus::getLastApplicableIndex() const
+{
+    // A configuration is sometimes missing for unit tests.
+    if (!configuration)
+        return commitIndex;
+    // Entries covered by the snapshot are durable in the snapshot itself.
+    uint64_t durableIndex = std::max(
+        lastSnapshotIndex,
+        configuration->localServer->lastSyncedIndex);
+    return std::min(commitIndex, durableIndex);
+}
+
 uint64_t
 RaftConsensus::getLastLogTerm() const
 {
     uint64_t lastLogIndex = log->getLastLogIndex();
     if (lastLogIndex >= log->getLogStartIndex()) {
-        return log->getEntry(lastLogIndex).term();
+        return log->getEntryTerm(lastLogIndex);
     } else {
         assert(lastLogIndex == lastSnapshotIndex); // potentially 0
         return lastSnapshotTerm;
@@ -2388,15 +3181,53 @@ void
 RaftConsensus::interruptAll()
 {
     stateChanged.notify_all();
+    publishCommitState();
     // A configuration is sometimes missing for unit tests.
     if (configuration)
         configuration->forEach(&Server::interrupt);
 }
 
+RaftConsensus::LentEntries::LentEntries(
+        Protocol::Raft::AppendEntries::Request& request)
+    : requestEntries(*request.mutable_entries())
+    , entries()
+{
+    assert(requestEntries.empty());
+}
+
+RaftConsensus::LentEntries::~LentEntries()
+{
+    while (!entries.empty())
+        removeLast();
+}
+
+void
+RaftConsensus::LentEntries::add(Log::EntryPtr entry)
+{
+    requestEntries.AddAllocated(const_cast<Log::Entry*>(entry.get()));
+    entries.push_back(std::move(entry));
+}
+
+void
+RaftConsensus::LentEntries::removeLast()
+{
+    Log::Entry* last = requestEntries.ReleaseLast();
+    assert(last == entries.back().get());
+    (void) last; // still owned by the log
+    entries.pop_back();
+}
+
+uint64_t
+RaftConsensus::LentEntries::size() const
+{
+    return entries.size();
+}
+
 uint64_t
 RaftConsensus::packEntries(
         uint64_t nextIndex,
-        Protocol::Raft::AppendEntries::Request& request) const
+        const Protocol::Raft::AppendEntries::Request& request,
+        LentEntries& lent) const
 {
     // Add as many as entries as will fit comfortably in the request. It's
     // easiest to add one entry at a time until the RPC gets too big, then back
@@ -2420,15 +3251,17 @@ RaftConsensus::packEntries(
     using Core::Util::downCast;
     uint64_t lastIndex = std::min(log->getLastLogIndex(),
                                   nextIndex + MAX_LOG_ENTRIES_PER_REQUEST - 1);
-    google::protobuf::RepeatedPtrField<Protocol::Raft::Entry>& requestEntries =
-        *request.mutable_entries();
 
     uint64_t numEntries = 0;
     uint64_t currentSize = downCast<uint64_t>(request.ByteSize());
 
     for (uint64_t index = nextIndex; index <= lastIndex; ++index) {
-        const Log::Entry& entry = log->getEntry(index);
-        *requestEntries.Add() = entry;
+        // Lend the log's entry to the request instead of copying it in. It's
+        // only read from here on: serializing the request happens under the
+        // Raft lock, like every other use of the shared entry's cached size.
+        Log::EntryPtr shared = log->getEntryPtr(index);
+        const Log::Entry& entry = *shared;
+        lent.add(std::move(shared));
 
         // Each member of a repeated message field is encoded with a tag
         // and a length. We conservatively assume the tag and length will
@@ -2445,7 +3278,7 @@ RaftConsensus::packEntries(
             if (currentSize >= SOFT_RPC_SIZE_LIMIT && numEntries > 0) {
                 // This entry doesn't fit and we've already got some
                 // entries to send: discard this one and stop adding more.
-                requestEntries.RemoveLast();
+                lent.removeLast();
                 break;
             }
         }
@@ -2453,7 +3286,7 @@ RaftConsensus::packEntries(
         ++numEntries;
     }
 
-    assert(numEntries == uint64_t(requestEntries.size()));
+    assert(numEntries == lent.size());
     return numEntries;
 }
 
@@ -2503,6 +3336,7 @@ RaftConsensus::readSnapshot()
         lastSnapshotClusterTime = header.last_cluster_time();
         lastSnapshotBytes = reader->getSizeBytes();
         commitIndex = std::max(lastSnapshotIndex, commitIndex);
+        publishCommitState();
 
         NOTICE("Reading snapshot which covers log entries 1 through %lu "
                "(inclusive)", lastSnapshotIndex);
@@ -2513,7 +3347,7 @@ RaftConsensus::readSnapshot()
         //    lastSnapshotTerm.
         if (log->getLastLogIndex() < lastSnapshotIndex ||
             (log->getLogStartIndex() <= lastSnapshotIndex &&
-             log->getEntry(lastSnapshotIndex).term() != lastSnapshotTerm)) {
+             log->getEntryTerm(lastSnapshotIndex) != lastSnapshotTerm)) {
             // The NOTICE message can be confusing if the log is empty, so
             // don't print it in that case. We still want to shift the log
             // start index, though.
@@ -2522,7 +3356,9 @@ RaftConsensus::readSnapshot()
                        "consistent with the snapshot that is being read");
             }
             // Discard the entire log, setting the log start to point to the
-            // right place.
+            // right place. First flush any writes the disk thread has yet to
+            // perform, since truncateSuffix() can't run under them.
+            syncLogNow();
             log->truncatePrefix(lastSnapshotIndex + 1);
             log->truncateSuffix(lastSnapshotIndex);
             configurationManager->truncatePrefix(lastSnapshotIndex + 1);
@@ -2531,9 +3367,7 @@ RaftConsensus::readSnapshot()
             if (state == State::LEADER) { // defer log sync
                 logSyncQueued = true;
             } else { // sync log now
-                std::unique_ptr<Log::Sync> sync = log->takeSync();
-                sync->wait();
-                log->syncComplete(std::move(sync));
+                syncLogNow();
             }
             clusterClock.newEpoch(lastSnapshotClusterTime);
         }
@@ -2573,12 +3407,15 @@ RaftConsensus::replicateEntry(Log::Entry& entry,
         entry.set_cluster_time(clusterClock.leaderStamp());
         append({&entry});
         uint64_t index = log->getLastLogIndex();
-        while (!exiting && currentTerm == entry.term()) {
-            if (commitIndex >= index) {
+        // Wait without the Raft lock; see commitMutex.
+        Core::MutexUnlock<Mutex> unlockGuard(lockGuard);
+        std::unique_lock<std::mutex> commitGuard(commitMutex);
+        while (!publishedExiting && publishedTerm == entry.term()) {
+            if (publishedCommitIndex >= index) {
                 VERBOSE("replicate succeeded");
                 return {ClientResult::SUCCESS, index};
             }
-            stateChanged.wait(lockGuard);
+            commitChanged.wait(commitGuard);
         }
     }
     return {ClientResult::NOT_LEADER, 0};
@@ -2593,28 +3430,39 @@ RaftConsensus::requestVote(std::unique_lock<Mutex>& lockGuard, Peer& peer)
     request.set_last_log_term(getLastLogTerm());
     request.set_last_log_index(log->getLastLogIndex());
 
-    Protocol::Raft::RequestVote::Response response;
     VERBOSE("requestVote start");
-    TimePoint start = Clock::now();
     uint64_t epoch = currentEpoch;
-    Peer::CallStatus status = peer.callRPC(
-                Protocol::Raft::OpCode::REQUEST_VOTE,
-                request, response,
-                lockGuard);
+    lastEpochSent = epoch;
+    std::unique_ptr<Peer::PendingRPC> sent(new Peer::PendingRPC(
+        Protocol::Raft::OpCode::REQUEST_VOTE,
+        currentTerm, epoch, Clock::now(), 0));
+    sent->rpc = peer.startRPC(Protocol::Raft::OpCode::REQUEST_VOTE,
+                              request,
+                              lockGuard);
+    sendPendingRPC(peer, std::move(sent));
+}
+
+void
+RaftConsensus::requestVoteDone(
+        Peer& peer,
+        const Peer::PendingRPC& sent,
+        Peer::CallStatus status,
+        const Protocol::Raft::RequestVote::Response& response)
+{
     VERBOSE("requestVote done");
     switch (status) {
         case Peer::CallStatus::OK:
             break;
         case Peer::CallStatus::FAILED:
             peer.suppressBulkData = true;
-            peer.backoffUntil = start + RPC_FAILURE_BACKOFF;
+            peer.backoffUntil = sent.start + RPC_FAILURE_BACKOFF;
             return;
         case Peer::CallStatus::INVALID_REQUEST:
             PANIC("The server's RaftService doesn't support the RequestVote "
                   "RPC or claims the request is malformed");
     }
 
-    if (currentTerm != request.term() || state != State::CANDIDATE ||
+    if (currentTerm != sent.term || state != State::CANDIDATE ||
         peer.exiting) {
         VERBOSE("ignore RPC result");
         // we don't care about result of RPC
@@ -2628,7 +3476,7 @@ RaftConsensus::requestVote(std::unique_lock<Mutex>& lockGuard, Peer& peer)
         stepDown(response.term());
     } else {
         peer.requestVoteDone = true;
-        peer.lastAckEpoch = epoch;
+        peer.lastAckEpoch = sent.epoch;
         stateChanged.notify_all();
 
         if (response.granted()) {
@@ -2680,6 +3528,17 @@ RaftConsensus::printElectionState() const
            votedFor);
 }
 
+void
+RaftConsensus::publishCommitState()
+{
+    std::lock_guard<std::mutex> commitGuard(commitMutex);
+    publishedCommitIndex = commitIndex;
+    publishedApplicableIndex = getLastApplicableIndex();
+    publishedTerm = currentTerm;
+    publishedExiting = exiting;
+    commitChanged.notify_all();
+}
+
 void
 RaftConsensus::startNewElection()
 {
@@ -2689,6 +3548,10 @@ RaftConsensus::startNewElection()
         return;
     }
 
+    // Candidates only advertise durable log entries, and a new leader
+    // assumes its whole log is durable.
+    syncLogNow();
+
     if (leaderId > 0) {
         NOTICE("Running for election in term %lu "
                "(haven't heard from leader %lu lately)",
@@ -2726,6 +3589,7 @@ void
 RaftConsensus::stepDown(uint64_t newTerm)
 {
     assert(currentTerm <= newTerm);
+    bool wasLeader = (state == State::LEADER);
     if (currentTerm < newTerm) {
         VERBOSE("stepDown(%lu)", newTerm);
         currentTerm = newTerm;
@@ -2751,23 +3615,11 @@ RaftConsensus::stepDown(uint64_t newTerm)
         withholdVotesUntil = TimePoint::min();
     interruptAll();
 
-    // If the leader disk thread is currently writing to disk, wait for it to
-    // finish. We poll here because we don't want to release the lock (this
-    // server would then believe its writes have been flushed when they
-    // haven't).
-    while (leaderDiskThreadWorking)
-        usleep(500);
-
-    // If a recent append has been queued, empty it here. Do this after waiting
-    // for leaderDiskThread to preserve FIFO ordering of Log::Sync objects.
-    // Don't bother updating the localServer's lastSyncedIndex, since it
-    // doesn't matter for non-leaders.
-    if (logSyncQueued) {
-        std::unique_ptr<Log::Sync> sync = log->takeSync();
-        sync->wait();
-        log->syncComplete(std::move(sync));
-        logSyncQueued = false;
-    }
+    // A former leader flushes its queued appends here, so that as a follower
+    // it may acknowledge any of its entries. (Followers with
+    // ASYNC_FOLLOWER_SYNC keep their queued appends for the disk thread.)
+    if (wasLeader)
+        syncLogNow();
 }
 
 void
@@ -2783,36 +3635,82 @@ RaftConsensus::updateLogMetadata()
 bool
 RaftConsensus::upToDateLeader(std::unique_lock<Mutex>& lockGuard) const
 {
-    ++currentEpoch;
+    ++numLeadershipChecks;
+    if (LEADER_LEASE.count() > 0) {
+        if (getLeaseRemaining().count() > 0 && commitIndexInCurrentTerm()) {
+            ++numLeaseHits;
+            return true;
+        }
+        ++numLeaseMisses;
+    }
+    // An acknowledgement only proves leadership if the peer received the
+    // epoch after this call began. If no peer has been sent currentEpoch
+    // yet, that holds for currentEpoch, so join the pending round.
+    if (currentEpoch <= lastEpochSent) {
+        ++currentEpoch;
+        ++numLeadershipRounds;
+    }
     uint64_t epoch = currentEpoch;
-    // schedule a heartbeat now so that this returns quickly
-    configuration->forEach(&Server::scheduleHeartbeat);
-    stateChanged.notify_all();
+    // Other code bumps currentEpoch without sending anything, so a pending
+    // round may have nobody driving it. Schedule a heartbeat now so that this
+    // returns quickly, unless another caller already has for this epoch.
+    if (lastEpochScheduled < epoch) {
+        lastEpochScheduled = epoch;
+        configuration->forEach(&Server::scheduleHeartbeat);
+        stateChanged.notify_all();
+    }
     while (true) {
         if (exiting || state != State::LEADER)
             return false;
         if (configuration->quorumMin(&Server::getLastAckEpoch) >= epoch) {
             // So we know we're the current leader, but do we have an
-            // up-to-date commitIndex yet? What we'd like to check is whether
-            // the entry's term at commitIndex matches our currentTerm, but
-            // snapshots mean that we may not have the entry in our log. Since
-            // commitIndex >= lastSnapshotIndex, we split into two cases:
-            uint64_t commitTerm;
-            if (commitIndex == lastSnapshotIndex) {
-                commitTerm = lastSnapshotTerm;
-            } else {
-                assert(commitIndex > lastSnapshotIndex);
-                assert(commitIndex >= log->getLogStartIndex());
-                assert(commitIndex <= log->getLastLogIndex());
-                commitTerm = log->getEntry(commitIndex).term();
-            }
-            if (commitTerm == currentTerm)
+            // up-to-date commitIndex yet?
+            if (commitIndexInCurrentTerm())
                 return true;
         }
         stateChanged.wait(lockGuard);
     }
 }
 
+bool
+RaftConsensus::commitIndexInCurrentTerm() const
+{
+    // What we'd like to check is whether the entry's term at commitIndex
+    // matches our currentTerm, but snapshots mean that we may not have the
+    // entry in our log. Since commitIndex >= lastSnapshotIndex, we split into
+    // two cases:
+    uint64_t commitTerm;
+    if (commitIndex == lastSnapshotIndex) {
+        commitTerm = lastSnapshotTerm;
+    } else {
+        assert(commitIndex > lastSnapshotIndex);
+        assert(commitIndex >= log->getLogStartIndex());
+        assert(commitIndex <= log->getLastLogIndex());
+        commitTerm = log->getEntryTerm(commitIndex);
+    }
+    return commitTerm == currentTerm;
+}
+
+std::chrono::nanoseconds
+RaftConsensus::getLeaseRemaining() const
+{
+    if (LEADER_LEASE.count() == 0 || exiting || state != State::LEADER)
+        return std::chrono::nanoseconds::zero();
+    // Followers heard from us no earlier than the time we sent them the
+    // RPCs they acknowledged; a quorum has done so since 'start'.
+    uint64_t start =
+        configuration->quorumMin(&Server::getLastAckSentNanos);
+    if (start == 0)
+        return std::chrono::nanoseconds::zero();
+    uint64_t now = uint64_t(Clock::now().time_since_epoch().count());
+    if (start > now) // only the local server (a single-server cluster)
+        return LEADER_LEASE;
+    std::chrono::nanoseconds elapsed(now - start);
+    if (elapsed >= LEADER_LEASE)
+        return std::chrono::nanoseconds::zero();
+    return LEADER_LEASE - elapsed;
+}
+
 std::ostream&
 operator<<(std::ostream& os, RaftConsensus::ClientResult clientResult)
 {
@@ -17,9 +17,11 @@
 #include <chrono>
 #include <deque>
 #include <functional>
+#include <list>
 #include <memory>
 #include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include "Protocol/gen-cpp/Client.pb.h"
 #include "Protocol/gen-cpp/Raft.pb.h"
@@ -29,6 +31,7 @@
 #include "Core/CompatAtomic.h"
 #include "Core/ConditionVariable.h"
 #include "Core/Mutex.h"
+#include "Core/RollingStat.h"
 #include "Core/Time.h"
 #include "RPC/ClientRPC.h"
 #include "Storage/Layout.h"
@@ -134,6 +137,12 @@ class Server {
      * Return the latest time this Server acknowledged our current term.
      */
     virtual uint64_t getLastAckEpoch() const = 0;
+    /**
+     * Return when (in nanoseconds on Clock) the leader sent this Server the
+     * latest RPC that it acknowledged in our current term, or 0 if none.
+     * Used to compute the leader's lease; see RaftConsensus::LEADER_LEASE.
+     */
+    virtual uint64_t getLastAckSentNanos() const = 0;
     /**
      * Return the largest entry ID for which this Server is known to share the
      * same entries up to and including this entry with our log.
@@ -231,6 +240,7 @@ class LocalServer : public Server {
     uint64_t getMatchIndex() const;
     bool haveVote() const;
     uint64_t getLastAckEpoch() const;
+    uint64_t getLastAckSentNanos() const;
     void interrupt();
     bool isCaughtUp() const;
     void scheduleHeartbeat();
@@ -240,8 +250,8 @@ class LocalServer : public Server {
     RaftConsensus& consensus;
     /**
      * The index of the last log entry that has been flushed to disk.
-     * Valid for leaders only. Returned by getMatchIndex() and used to
-     * advance the leader's commitIndex.
+     * Returned by getMatchIndex() and used to advance the leader's
+     * commitIndex. Followers use it to acknowledge only durable entries.
      */
     uint64_t lastSyncedIndex;
 };
@@ -272,6 +282,7 @@ class Peer : public Server {
     void beginLeadership();
     void exit();
     uint64_t getLastAckEpoch() const;
+    uint64_t getLastAckSentNanos() const;
     uint64_t getMatchIndex() const;
     bool haveVote() const;
     bool isCaughtUp() const;
@@ -279,7 +290,7 @@ class Peer : public Server {
     void scheduleHeartbeat();
 
     /**
-     * Returned by callRPC().
+     * Returned by decodeReply().
      */
     enum class CallStatus {
         /**
@@ -299,26 +310,87 @@ class Peer : public Server {
     };
 
     /**
-     * Execute a remote procedure call on the server's RaftService. As this
-     * operation might take a while, it should be called without RaftConsensus
-     * lock.
+     * Send a remote procedure call to the server's RaftService without
+     * waiting for its reply. Once the returned RPC completes, its reply is
+     * read using decodeReply().
      * \param[in] opCode
      *      The RPC opcode to execute (see Protocol::Raft::OpCode).
      * \param[in] request
      *      The request that was received from the other server.
+     * \param[in] lockGuard
+     *      The Raft lock, which may be released internally while a new
+     *      session is created.
+     * \return
+     *      The outstanding RPC.
+     */
+    RPC::ClientRPC
+    startRPC(Protocol::Raft::OpCode opCode,
+             const google::protobuf::Message& request,
+             std::unique_lock<Mutex>& lockGuard);
+
+    /**
+     * Decode the reply of an RPC returned by startRPC() that has already
+     * completed; this never blocks.
+     * \param[in] rpc
+     *      The finished RPC (rpc.isReady() must be true).
      * \param[out] response
      *      Where the reply should be placed, if status is OK.
-     * \param[in] lockGuard
-     *      The Raft lock, which is released internally to allow for I/O
-     *      concurrency.
      * \return
      *      See CallStatus.
      */
     CallStatus
-    callRPC(Protocol::Raft::OpCode opCode,
-            const google::protobuf::Message& request,
-            google::protobuf::Message& response,
-            std::unique_lock<Mutex>& lockGuard);
+    decodeReply(RPC::ClientRPC& rpc,
+                google::protobuf::Message& response);
+
+    /**
+     * Describes an AppendEntries request that was sent to the server, as
+     * needed to process its response.
+     */
+    struct AppendEntriesRPC {
+        AppendEntriesRPC(uint64_t term,
+                         uint64_t prevLogIndex,
+                         uint64_t numEntries,
+                         uint64_t epoch,
+                         TimePoint start);
+        AppendEntriesRPC(AppendEntriesRPC&& other);
+        /// The leader's term when the request was sent.
+        uint64_t term;
+        /// The request's prev_log_index.
+        uint64_t prevLogIndex;
+        /// The number of entries carried by the request.
+        uint64_t numEntries;
+        /// RaftConsensus::currentEpoch when the request was sent.
+        uint64_t epoch;
+        /// When the request was sent.
+        TimePoint start;
+        /// The outstanding RPC.
+        RPC::ClientRPC rpc;
+    };
+
+    /**
+     * Describes a RequestVote or InstallSnapshot request that was sent to the
+     * server, as needed to process its response. At most one of these is
+     * outstanding per server at a time (see #pendingRPC).
+     */
+    struct PendingRPC {
+        PendingRPC(Protocol::Raft::OpCode opCode,
+                   uint64_t term,
+                   uint64_t epoch,
+                   TimePoint start,
+                   uint64_t numDataBytes);
+        /// Either REQUEST_VOTE or INSTALL_SNAPSHOT.
+        Protocol::Raft::OpCode opCode;
+        /// The sender's term when the request was sent.
+        uint64_t term;
+        /// RaftConsensus::currentEpoch when the request was sent.
+        uint64_t epoch;
+        /// When the request was sent.
+        TimePoint start;
+        /// The number of snapshot bytes carried by an InstallSnapshot request.
+        uint64_t numDataBytes;
+        /// The outstanding RPC.
+        RPC::ClientRPC rpc;
+    };
 
     /**
      * Launch this Peer's thread, which should run
@@ -402,6 +474,11 @@ class Peer : public Server {
      */
     uint64_t lastAckEpoch;
 
+    /**
+     * See #getLastAckSentNanos().
+     */
+    uint64_t lastAckSentNanos;
+
     /**
      * When the next heartbeat should be sent to the follower.
      * Only valid while we're leader. The leader sends heartbeats periodically
@@ -424,7 +501,7 @@ class Peer : public Server {
 
     /**
      * Counts RPC failures to issue fewer warnings.
-     * Accessed only from callRPC() without holding the lock.
+     * Accessed only from decodeReply().
      */
     uint64_t rpcFailuresSinceLastWarning;
 
@@ -456,19 +533,39 @@ class Peer : public Server {
      */
     uint64_t lastSnapshotIndex;
 
-  private:
+    /**
+     * AppendEntries requests (including heartbeats) that have been sent to
+     * the follower but whose responses have not yet been processed, oldest
+     * first. At most RaftConsensus::MAX_APPEND_ENTRIES_IN_FLIGHT long. Each
+     * RPC's completion callback queues this Peer for
+     * RaftConsensus::replicationThreadMain, which removes completed requests
+     * (in any order) while holding the Raft lock, so no thread blocks waiting
+     * on these RPCs.
+     */
+    std::list<AppendEntriesRPC> appendEntriesInFlight;
 
     /**
-     * Caches the result of getSession().
+     * The RequestVote or InstallSnapshot request that has been sent to the
+     * server but whose response has not yet been processed, or NULL. Like
+     * #appendEntriesInFlight, its response is processed by
+     * RaftConsensus::replicationThreadMain. The peer thread sends nothing
+     * else to the server while this is set.
      */
-    std::shared_ptr<RPC::ClientSession> session;
+    std::unique_ptr<PendingRPC> pendingRPC;
+
+    /**
+     * A weak reference to this object, set by startThread(). Completion
+     * callbacks for #appendEntriesInFlight and #pendingRPC hold this rather
+     * than a shared_ptr so that they don't keep a removed Peer alive.
+     */
+    std::weak_ptr<Peer> weakSelf;
+
+  private:
 
     /**
-     * callRPC() places its RPC here so that interrupt() may cancel it.
-     * Setting this member and canceling the RPC must be done while holding the
-     * Raft lock; waiting on the RPC is done without holding that lock.
+     * Caches the result of getSession().
      */
-    RPC::ClientRPC rpc;
+    std::shared_ptr<RPC::ClientSession> session;
 
     // Peer is not copyable.
     Peer(const Peer&) = delete;
@@ -941,10 +1038,16 @@ class RaftConsensus {
         } type;
 
         /**
-         * The client request for entries of type 'DATA'.
+         * The client request for entries of type 'DATA'. This refers to the
+         * log entry's data rather than a copy of it.
          */
         Core::Buffer command;
 
+        /**
+         * Keeps the log entry that 'command' refers to alive.
+         */
+        Storage::Log::EntryPtr logEntry;
+
         /**
          * A handle to the snapshot file for entries of type 'SNAPSHOT'.
          */
@@ -1025,6 +1128,17 @@ class RaftConsensus {
      */
     std::pair<ClientResult, uint64_t> getLastCommitIndex() const;
 
+    /**
+     * Ask the current leader for an index after which this follower may
+     * serve a linearizable read (see #FOLLOWER_READS). This blocks for up to
+     * an election timeout while the leader confirms its leadership.
+     * \return
+     *      SUCCESS and the read index, or NOT_LEADER if follower reads are
+     *      disabled, this server is not a follower, or the leader could not
+     *      be reached.
+     */
+    std::pair<ClientResult, uint64_t> getReadIndexFromLeader();
+
     /**
      * Return the network address for a recent leader, if known,
      * or empty string otherwise.
@@ -1044,6 +1158,22 @@ class RaftConsensus {
      */
     Entry getNextEntry(uint64_t lastIndex) const;
 
+    /**
+     * Like getNextEntry(), but returns all committed entries following
+     * lastIndex (at least one), up to maxEntries of them. This lets the state
+     * machine apply many entries per call. A SNAPSHOT entry is always
+     * returned on its own. Entries are only returned once they are durable
+     * in the local log; see getLastApplicableIndex().
+     * \param lastIndex
+     *      The index of the last entry the state machine has applied.
+     * \param maxEntries
+     *      The maximum number of entries to return; must be at least 1.
+     * \throw Core::Util::ThreadInterruptedException
+     *      Thread should exit.
+     */
+    std::vector<Entry> getNextEntries(uint64_t lastIndex,
+                                      uint64_t maxEntries) const;
+
     /**
      * Return statistics that may be useful in deciding when to snapshot.
      */
@@ -1052,12 +1182,13 @@ class RaftConsensus {
     /**
      * Process an AppendEntries RPC from another server. Called by RaftService.
      * \param[in] request
-     *      The request that was received from the other server.
+     *      The request that was received from the other server. The new
+     *      entries are moved out of it into the log rather than copied.
      * \param[out] response
      *      Where the reply should be placed.
      */
     void handleAppendEntries(
-                const Protocol::Raft::AppendEntries::Request& request,
+                Protocol::Raft::AppendEntries::Request& request,
                 Protocol::Raft::AppendEntries::Response& response);
 
     /**
@@ -1072,6 +1203,17 @@ class RaftConsensus {
                 const Protocol::Raft::InstallSnapshot::Request& request,
                 Protocol::Raft::InstallSnapshot::Response& response);
 
+    /**
+     * Process a GetReadIndex RPC from a follower. Called by RaftService.
+     * \param[in] request
+     *      The request that was received from the other server.
+     * \param[out] response
+     *      Where the reply should be placed.
+     */
+    void handleGetReadIndex(
+                const Protocol::Raft::GetReadIndex::Request& request,
+                Protocol::Raft::GetReadIndex::Response& response);
+
     /**
      * Process a RequestVote RPC from another server. Called by RaftService.
      * \param[in] request
@@ -1083,7 +1225,9 @@ class RaftConsensus {
                            Protocol::Raft::RequestVote::Response& response);
 
     /**
-     * Submit an operation to the replicated log.
+     * Submit an operation to the replicated log. Unless proposal batching is
+     * disabled, the operation is queued for #proposerThread, which appends
+     * many queued operations to the log at once.
      * \param operation
      *      If the cluster accepts this operation, then it will be added to the
      *      log and the state machine will eventually apply it.
@@ -1163,6 +1307,29 @@ class RaftConsensus {
                                     const RaftConsensus& raft);
 
   private:
+    /**
+     * An operation waiting in the proposal queue to be appended to the log by
+     * proposerThreadMain(). These live on the stack of the thread that called
+     * replicate(), which waits until #done is set (or the proposer has
+     * exited).
+     */
+    struct Proposal {
+        explicit Proposal(const Core::Buffer& operation);
+        /// The operation to append.
+        const Core::Buffer& operation;
+        /// Next proposal in #proposalQueue (which is a stack).
+        Proposal* next;
+        /// When replicate() queued this proposal.
+        TimePoint enqueued;
+        /// Set by the proposer once it has handled this proposal. Protected
+        /// by #commitMutex.
+        bool done;
+        /// The term in which the entry was appended, if it was.
+        uint64_t term;
+        /// The entry's log index, or 0 if this server wasn't leader.
+        uint64_t index;
+    };
+
     /**
      * See #state.
      */
@@ -1197,11 +1364,13 @@ class RaftConsensus {
     //// The following private methods MUST acquire the lock.
 
     /**
-     * Flush log entries to stable storage in the background on leaders.
-     * Once they're flushed, it tries to advance the #commitIndex.
-     * This is the method that #leaderDiskThread executes.
+     * Flush log entries to stable storage in the background on leaders (and
+     * on followers, with ASYNC_FOLLOWER_SYNC). Once they're flushed, a leader
+     * tries to advance the #commitIndex, and a follower lets waiting
+     * AppendEntries handlers acknowledge them.
+     * This is the method that #diskThread executes.
      */
-    void leaderDiskThreadMain();
+    void diskThreadMain();
 
     /**
      * Start new elections when it's time to do so. This is the method that
@@ -1212,9 +1381,26 @@ class RaftConsensus {
     /**
      * Initiate RPCs to a specific server as necessary.
      * One thread for each remote server calls this method (see Peer::thread).
+     * It only decides when to send requests; their responses are processed
+     * by #replicationThreads, so this thread never waits on the network.
      */
     void peerThreadMain(std::shared_ptr<Peer> peer);
 
+    /**
+     * Process responses to the RPCs sent to whichever peers the event loop
+     * reports as ready, and refill their AppendEntries windows. The threads
+     * in #replicationThreads execute this.
+     */
+    void replicationThreadMain();
+
+    /**
+     * Hand a peer with a completed RPC to #replicationThreads. This is
+     * called from RPC completion callbacks on the event loop thread, so it
+     * must not acquire #mutex (it only takes #replyMutex), but it may also be
+     * called with #mutex held.
+     */
+    void queueReplicationWork(std::weak_ptr<Peer> peer);
+
     /**
      * Return to follower state when, as leader, this server is not able to
      * communicate with a quorum. This helps two things in cases where a quorum
@@ -1226,6 +1412,15 @@ class RaftConsensus {
      */
     void stepDownThreadMain();
 
+    /**
+     * Drain the proposal queue filled by replicate(), appending up to
+     * MAX_PROPOSAL_BATCH_ENTRIES operations to the log at a time. This is the
+     * method that #proposerThread executes. Unlike the other thread methods,
+     * this only acquires the Raft lock to append a batch, since it must not
+     * hold that lock while waiting on #proposalMutex.
+     */
+    void proposerThreadMain();
+
 
     //// The following private methods MUST NOT acquire the lock.
 
@@ -1248,34 +1443,130 @@ class RaftConsensus {
 
     /**
      * Append entries to the log, set the configuration if this contains a
-     * configuration entry, and notify #stateChanged.
+     * configuration entry, and notify #stateChanged. The log shares the given
+     * entries rather than copying them.
+     */
+    void append(const std::vector<Storage::Log::EntryPtr>& entries);
+
+    /**
+     * Copy entries into the log as above. This is convenient for small
+     * entries built on the stack.
      */
     void append(const std::vector<const Storage::Log::Entry*>& entries);
 
     /**
      * Send an AppendEntries RPC to the server (either a heartbeat or containing
-     * an entry to replicate).
+     * an entry to replicate) without waiting for its response, which
+     * processAppendEntriesReplies() handles later.
      * \param lockGuard
-     *      Used to temporarily release the lock while invoking the RPC, so as
-     *      to allow for some concurrency.
+     *      Used to temporarily release the lock if a new session to the peer
+     *      must be created.
      * \param peer
      *      State used in communicating with the follower, building the RPC
      *      request, and processing its result.
      */
     void appendEntries(std::unique_lock<Mutex>& lockGuard, Peer& peer);
 
+    /**
+     * Process the result of an AppendEntries RPC. With pipelining, responses
+     * may refer to requests sent before #Peer::nextIndex was last adjusted,
+     * so this only ever moves matchIndex forwards and, on failures, only
+     * moves nextIndex backwards.
+     * \param peer
+     *      The server the request was sent to.
+     * \param sent
+     *      Describes the request.
+     * \param status
+     *      How the RPC completed.
+     * \param response
+     *      The server's response, if status is OK.
+     */
+    void appendEntriesDone(Peer& peer,
+                           const Peer::AppendEntriesRPC& sent,
+                           Peer::CallStatus status,
+                           const Protocol::Raft::AppendEntries::Response&
+                                response);
+
+    /**
+     * Return true if another AppendEntries request carrying new entries may
+     * be pipelined to the peer right now: this server is leader, the peer's
+     * window has room, and the next request needs neither a snapshot nor a
+     * probe to find where the follower's log diverges.
+     */
+    bool canPipelineAppendEntries(const Peer& peer) const;
+
+    /**
+     * Return true if an AppendEntries request sent to the peer in this term
+     * with a smaller prev_log_index than the given one is still outstanding.
+     * Used to recognize rejections caused by the follower handling pipelined
+     * requests out of order.
+     */
+    bool appendEntriesInFlightBefore(const Peer& peer,
+                                     uint64_t prevLogIndex) const;
+
+    /**
+     * Process the responses to the peer's pipelined AppendEntries requests
+     * that have already completed, in whatever order they completed, then
+     * send more entries if the window has room. This never blocks on the
+     * network.
+     * \param lockGuard
+     *      Used to temporarily release the lock if a new session to the peer
+     *      must be created.
+     * \param peer
+     *      The server whose responses to process.
+     */
+    void processAppendEntriesReplies(std::unique_lock<Mutex>& lockGuard,
+                                     Peer& peer);
+
+    /**
+     * Process the response to the peer's RequestVote or InstallSnapshot
+     * request (see Peer::pendingRPC), if it has already completed.
+     * \param lockGuard
+     *      The Raft lock, which is not released since the RPC is ready.
+     * \param peer
+     *      The server whose response to process.
+     */
+    void processPendingReply(std::unique_lock<Mutex>& lockGuard, Peer& peer);
+
+    /**
+     * Make a RequestVote or InstallSnapshot request the peer's
+     * Peer::pendingRPC and arrange for #replicationThreads to process its
+     * response.
+     * \pre
+     *      The peer has no other pending RPC.
+     */
+    void sendPendingRPC(Peer& peer, std::unique_ptr<Peer::PendingRPC> sent);
+
     /**
      * Send an InstallSnapshot RPC to the server (containing part of a
-     * snapshot file to replicate).
+     * snapshot file to replicate) without waiting for its response, which
+     * installSnapshotDone() handles later.
      * \param lockGuard
-     *      Used to temporarily release the lock while invoking the RPC, so as
-     *      to allow for some concurrency.
+     *      Used to temporarily release the lock if a new session to the peer
+     *      must be created.
      * \param peer
-     *      State used in communicating with the follower, building the RPC
-     *      request, and processing its result.
+     *      State used in communicating with the follower and building the RPC
+     *      request.
      */
     void installSnapshot(std::unique_lock<Mutex>& lockGuard, Peer& peer);
 
+    /**
+     * Process the result of an InstallSnapshot RPC.
+     * \param peer
+     *      The server the request was sent to.
+     * \param sent
+     *      Describes the request.
+     * \param status
+     *      How the RPC completed.
+     * \param response
+     *      The server's response, if status is OK.
+     */
+    void installSnapshotDone(Peer& peer,
+                             const Peer::PendingRPC& sent,
+                             Peer::CallStatus status,
+                             const Protocol::Raft::InstallSnapshot::Response&
+                                response);
+
     /**
      * Transition to being a leader. This is called when a candidate has
      * received votes from a quorum.
@@ -1288,12 +1579,31 @@ class RaftConsensus {
      */
     void discardUnneededEntries();
 
+    /**
+     * Flush all log writes to stable storage while holding the lock. This
+     * first waits for #diskThread to finish any sync it is working on, so
+     * that Log::Sync objects complete in FIFO order, and it invalidates any
+     * result #diskThread has yet to record (see #logSyncGeneration).
+     * Afterwards, the local server's lastSyncedIndex is the last log index.
+     */
+    void syncLogNow();
+
     /**
      * Return the term corresponding to log->getLastLogIndex(). This may come
      * from the log, from the snapshot, or it may be 0.
      */
     uint64_t getLastLogTerm() const;
 
+    /**
+     * Return the last index the state machine may apply: #commitIndex, but
+     * no further than what is durable locally, in the snapshot or up to the
+     * local server's lastSyncedIndex. A follower can learn that entries are
+     * committed before its own copies of them are durable (see
+     * asyncFollowerSync); applying those to the store could leave the store
+     * ahead of the log after a crash.
+     */
+    uint64_t getLastApplicableIndex() const;
+
     /**
      * Notify the #stateChanged condition variable and cancel all current RPCs.
      * This should be called when stepping down, starting a new election,
@@ -1301,6 +1611,34 @@ class RaftConsensus {
      */
     void interruptAll();
 
+    /**
+     * Lends log entries to an AppendEntries request instead of copying them
+     * in. The request's entries field points at the log's own entries, which
+     * this keeps alive; the destructor takes them back out of the request
+     * without deleting them. It must therefore be destroyed before the
+     * request.
+     */
+    class LentEntries {
+      public:
+        explicit LentEntries(Protocol::Raft::AppendEntries::Request& request);
+        ~LentEntries();
+        /// Append 'entry' to the request.
+        void add(Storage::Log::EntryPtr entry);
+        /// Take the last entry added back out of the request.
+        void removeLast();
+        /// Return the number of entries in the request.
+        uint64_t size() const;
+      private:
+        /// The request's entries field.
+        google::protobuf::RepeatedPtrField<Protocol::Raft::Entry>&
+            requestEntries;
+        /// Keeps the entries in #requestEntries alive.
+        std::vector<Storage::Log::EntryPtr> entries;
+        // LentEntries is not copyable.
+        LentEntries(const LentEntries&) = delete;
+        LentEntries& operator=(const LentEntries&) = delete;
+    };
+
     /**
      * Helper for #appendEntries() to put the right number of entries into the
      * request.
@@ -1308,12 +1646,15 @@ class RaftConsensus {
      *      First entry to send to the follower.
      * \param request
      *      AppendEntries request ProtoBuf in which to pack the entries.
+     * \param lent
+     *      Lends the entries to 'request'; see LentEntries.
      * \return
      *      Number of entries in the request.
      */
     uint64_t
     packEntries(uint64_t nextIndex,
-                Protocol::Raft::AppendEntries::Request& request) const;
+                const Protocol::Raft::AppendEntries::Request& request,
+                LentEntries& lent) const;
 
     /**
      * Try to read the latest good snapshot from disk. Loads the header of the
@@ -1336,22 +1677,47 @@ class RaftConsensus {
     /**
      * Send a RequestVote RPC to the server. This is used by candidates to
      * request a server's vote and by new leaders to retrieve information about
-     * the server's log.
+     * the server's log. The response is handled later by requestVoteDone().
      * \param lockGuard
-     *      Used to temporarily release the lock while invoking the RPC, so as
-     *      to allow for some concurrency.
+     *      Used to temporarily release the lock if a new session to the peer
+     *      must be created.
      * \param peer
-     *      State used in communicating with the follower, building the RPC
-     *      request, and processing its result.
+     *      State used in communicating with the server and building the RPC
+     *      request.
      */
     void requestVote(std::unique_lock<Mutex>& lockGuard, Peer& peer);
 
+    /**
+     * Process the result of a RequestVote RPC.
+     * \param peer
+     *      The server the request was sent to.
+     * \param sent
+     *      Describes the request.
+     * \param status
+     *      How the RPC completed.
+     * \param response
+     *      The server's response, if status is OK.
+     */
+    void requestVoteDone(Peer& peer,
+                         const Peer::PendingRPC& sent,
+                         Peer::CallStatus status,
+                         const Protocol::Raft::RequestVote::Response&
+                            response);
+
     /**
      * Dumps serverId, currentTerm, state, leaderId, and votedFor to the debug
      * log. This is intended to be easy to grep and parse.
      */
     void printElectionState() const;
 
+    /**
+     * Copy #commitIndex, getLastApplicableIndex(), #currentTerm, and #exiting
+     * into the fields protected by #commitMutex and notify #commitChanged.
+     * This must be called whenever any of those change, before #mutex is next
+     * released.
+     */
+    void publishCommitState();
+
     /**
      * Set the timer to start a new election and notify #stateChanged.
      * The timer is set for ELECTION_TIMEOUT plus some random jitter from
@@ -1391,9 +1757,25 @@ class RaftConsensus {
      * This is used to provide non-stale read operations to
      * clients. It gives up after ELECTION_TIMEOUT, since stepDownThread
      * will return to the follower state after that time.
+     * Concurrent callers are batched: all callers that arrive before any
+     * peer has been sent the current epoch wait on the same round of
+     * heartbeats.
      */
     bool upToDateLeader(std::unique_lock<Mutex>& lockGuard) const;
 
+    /**
+     * Return true if this server is leader and has committed an entry in its
+     * current term, so that its commitIndex covers every entry that any
+     * previous leader may have committed.
+     */
+    bool commitIndexInCurrentTerm() const;
+
+    /**
+     * Return how much longer this leader's lease lasts, or zero if it has
+     * expired or leases are disabled. See LEADER_LEASE.
+     */
+    std::chrono::nanoseconds getLeaseRemaining() const;
+
     /**
      * Print out a ClientResult for debugging purposes.
      */
@@ -1431,6 +1813,60 @@ class RaftConsensus {
      */
     const std::chrono::nanoseconds RPC_FAILURE_BACKOFF;
 
+    /**
+     * If nonzero, a leader serves read-only queries without contacting its
+     * peers for this long after a quorum acknowledged its heartbeats. This is
+     * safe because followers refuse to vote for ELECTION_TIMEOUT after hearing
+     * from the leader, so it must be less than ELECTION_TIMEOUT; the
+     * difference absorbs clock drift between servers.
+     */
+    const std::chrono::nanoseconds LEADER_LEASE;
+
+    /**
+     * If true, followers serve read-only queries themselves, after asking the
+     * leader for a read index with the GetReadIndex RPC, rather than
+     * redirecting clients to the leader.
+     */
+    const bool FOLLOWER_READS;
+
+    /**
+     * The maximum number of AppendEntries RPCs a leader keeps outstanding to
+     * each follower. With 1, the leader waits for each response before
+     * sending the next request; larger values let it advance the follower's
+     * nextIndex optimistically and send new entries while earlier ones are
+     * still in flight, so replication is not limited to one batch per round
+     * trip.
+     */
+    const uint64_t MAX_APPEND_ENTRIES_IN_FLIGHT;
+
+    /**
+     * The number of #replicationThreads that process RPC responses for all
+     * peers (at least 1).
+     */
+    const uint64_t REPLICATION_THREADS;
+
+    /**
+     * If true, followers hand their log writes to #diskThread rather than
+     * syncing them while holding #mutex. AppendEntries handlers then wait,
+     * without the lock, until their entries are durable before acknowledging
+     * them, so a slow disk doesn't hold up heartbeats, votes, and other RPCs.
+     */
+    const bool ASYNC_FOLLOWER_SYNC;
+
+    /**
+     * The maximum number of client operations #proposerThread appends to the
+     * log at once. 0 disables the proposal queue, so that each replicate()
+     * call appends its own entry.
+     */
+    const uint64_t MAX_PROPOSAL_BATCH_ENTRIES;
+
+    /**
+     * How long #proposerThread may hold the oldest queued operation while
+     * waiting for more to fill a batch. This bounds the latency that batching
+     * adds to each write; 0 appends whatever is queued right away.
+     */
+    const std::chrono::nanoseconds PROPOSAL_BATCH_DELAY;
+
     /**
      * Prefer to keep RPC requests under this size.
      * Const except for unit tests.
@@ -1469,7 +1905,11 @@ class RaftConsensus {
     /**
      * This class behaves mostly like a monitor. This protects all the state in
      * this class and almost all of the Peer class (with some
-     * documented exceptions).
+     * documented exceptions). In particular, the commit and apply notification
+     * state is protected by #commitMutex instead, the proposal queue by
+     * #proposalMutex, and the queue of peers with completed RPCs by
+     * #replyMutex. Any of those may be acquired while holding this lock, but
+     * this lock must never be acquired while holding one of them.
      */
     mutable Mutex mutex;
 
@@ -1487,11 +1927,60 @@ class RaftConsensus {
      *  - an acknowledgement from a peer is received.
      *  - a server goes from not caught up to caught up.
      *  - a heartbeat is scheduled.
-     * TODO(ongaro): Should there be multiple condition variables? This one is
-     * used by a lot of threads for a lot of different conditions.
+     * This is waited on by the server's own threads (peers, timer, disk,
+     * step-down), leadership checks, and setConfiguration(). Threads waiting
+     * for entries to be committed wait on #commitChanged instead, so that the
+     * many log, ack, and timer events that don't affect them don't wake them
+     * up.
      */
     mutable Core::ConditionVariable stateChanged;
 
+    /**
+     * Protects #commitChanged, #publishedCommitIndex,
+     * #publishedApplicableIndex, #publishedTerm, #publishedExiting,
+     * #proposerExited, and Proposal::done. This lets client
+     * threads in replicate() and the state machine in getNextEntries() sleep,
+     * wake up, and check on their entries without acquiring #mutex. It may be
+     * acquired while holding #mutex, but never the other way around.
+     */
+    mutable std::mutex commitMutex;
+
+    /**
+     * Notified by publishCommitState() and #proposerThread when something a
+     * thread waiting for commitment might be waiting on changes:
+     *  - commitIndex changes (including when a new snapshot is loaded).
+     *  - the local log is synced past the applicable index.
+     *  - term changes, or exiting is set.
+     *  - #proposerThread appends a batch of proposals or exits.
+     * This is waited on with #commitMutex by client threads in replicate()
+     * and by the state machine in getNextEntries(), which can be numerous.
+     */
+    mutable Core::ConditionVariable commitChanged;
+
+    /**
+     * A copy of #commitIndex, set by publishCommitState(). Protected by
+     * #commitMutex.
+     */
+    uint64_t publishedCommitIndex;
+
+    /**
+     * A copy of getLastApplicableIndex(), set by publishCommitState().
+     * Protected by #commitMutex.
+     */
+    uint64_t publishedApplicableIndex;
+
+    /**
+     * A copy of #currentTerm, set by publishCommitState(). Protected by
+     * #commitMutex.
+     */
+    uint64_t publishedTerm;
+
+    /**
+     * A copy of #exiting, set by publishCommitState(). Protected by
+     * #commitMutex.
+     */
+    bool publishedExiting;
+
     /**
      * Set to true when this class is about to be destroyed. When this is true,
      * threads must exit right away and no more RPCs should be sent or
@@ -1500,9 +1989,9 @@ class RaftConsensus {
     bool exiting;
 
     /**
-     * The number of Peer::thread threads that are still using this
-     * RaftConsensus object. When they exit, they decrement this and notify
-     * #stateChanged.
+     * The number of peer threads (peerThreadMain) that
+     * are still using this RaftConsensus object. When they exit, they
+     * decrement this and notify #stateChanged.
      */
     uint32_t numPeerThreads;
 
@@ -1515,22 +2004,31 @@ class RaftConsensus {
     std::unique_ptr<Storage::Log> log;
 
     /**
-     * Flag to indicate that #leaderDiskThreadMain should flush recent log
-     * writes to stable storage. This is always false for followers and
-     * candidates and is only used for leaders.
+     * Flag to indicate that #diskThreadMain should flush recent log
+     * writes to stable storage. This is only used for leaders and, with
+     * ASYNC_FOLLOWER_SYNC, for followers; it is always false for candidates.
      *
-     * When a server steps down, it waits for all syncs to complete, that way
-     * followers can assume that all of their log entries are durable when
-     * replying to leaders.
+     * When a leader steps down or a follower starts an election, it waits for
+     * all syncs to complete. Followers only acknowledge entries up to the
+     * local server's lastSyncedIndex, so leaders can assume that acknowledged
+     * entries are durable.
      */
     bool logSyncQueued;
 
     /**
-     * Used for stepDown() to wait on #leaderDiskThread without releasing
-     * #mutex. This is true while #leaderDiskThread is writing to disk. It's
+     * Used for syncLogNow() to wait on #diskThread without releasing
+     * #mutex. This is true while #diskThread is writing to disk. It's
      * set to true while holding #mutex; set to false without #mutex.
      */
-    std::atomic<bool> leaderDiskThreadWorking;
+    std::atomic<bool> diskThreadWorking;
+
+    /**
+     * Incremented whenever a sync that #diskThread has taken may no longer
+     * describe the log: when syncLogNow() runs and when a follower truncates
+     * its log. #diskThread only records its result as the local server's
+     * lastSyncedIndex if this hasn't changed in the meantime.
+     */
+    uint64_t logSyncGeneration;
 
     /**
      * Defines the servers that are part of the cluster. See Configuration.
@@ -1633,6 +2131,22 @@ class RaftConsensus {
     // TODO(ongaro): rename, explain more
     mutable uint64_t currentEpoch;
 
+    /**
+     * The value of currentEpoch most recently sent to a peer in an RPC
+     * request. While currentEpoch is greater than this, no peer has been
+     * asked to acknowledge currentEpoch yet, so upToDateLeader() callers can
+     * share that round instead of starting another one.
+     */
+    uint64_t lastEpochSent;
+
+    /**
+     * The largest value of currentEpoch for which upToDateLeader() has
+     * scheduled heartbeats to every peer. This is tracked separately from
+     * #lastEpochSent because currentEpoch is also incremented in places that
+     * don't send anything right away.
+     */
+    mutable uint64_t lastEpochScheduled;
+
     /**
      * Tracks the passage of "cluster time". See ClusterClock.
      */
@@ -1673,10 +2187,128 @@ class RaftConsensus {
     uint64_t numEntriesTruncated;
 
     /**
-     * The thread that executes leaderDiskThreadMain() to flush log entries to
-     * stable storage in the background on leaders.
+     * The number of upToDateLeader() calls, and the number of leadership
+     * confirmation rounds they started. Calls that arrive before the last
+     * round's heartbeats go out share that round.
+     */
+    mutable uint64_t numLeadershipChecks;
+    mutable uint64_t numLeadershipRounds;
+
+    /**
+     * The number of upToDateLeader() calls answered from the leader lease,
+     * and the number that found the lease expired (see LEADER_LEASE).
      */
-    std::thread leaderDiskThread;
+    mutable uint64_t numLeaseHits;
+    mutable uint64_t numLeaseMisses;
+
+    /**
+     * Follower reads: the number of read indexes this follower requested
+     * from the leader, how many of those requests failed, and the number
+     * this server handed out as leader.
+     */
+    uint64_t numReadIndexRequested;
+    uint64_t numReadIndexFailed;
+    uint64_t numReadIndexServed;
+
+    /**
+     * Session to the leader used for GetReadIndex RPCs, and the ID of the
+     * server it connects to. Created on demand by getReadIndexFromLeader().
+     */
+    std::shared_ptr<RPC::ClientSession> leaderReadSession;
+    uint64_t leaderReadSessionServerId;
+
+    /**
+     * Operations queued by replicate() for #proposerThread, most recent
+     * first. Threads push onto this without any lock; the proposer takes the
+     * whole stack at once.
+     */
+    std::atomic<Proposal*> proposalQueue;
+
+    /**
+     * Used with #proposalAvailable to put #proposerThread to sleep while the
+     * proposal queue is empty. Never acquire #mutex while holding this.
+     */
+    std::mutex proposalMutex;
+
+    /**
+     * Notified when a proposal is pushed onto an empty #proposalQueue, and
+     * when #proposerExiting is set.
+     */
+    Core::ConditionVariable proposalAvailable;
+
+    /**
+     * Set by exit() to tell #proposerThread to stop. Protected by
+     * #proposalMutex.
+     */
+    bool proposerExiting;
+
+    /**
+     * Set by #proposerThread once it will no longer touch queued proposals.
+     * Protected by #commitMutex.
+     */
+    bool proposerExited;
+
+    /**
+     * The number of operations appended through the proposal queue, and the
+     * number of batches they were appended in.
+     */
+    uint64_t numProposals;
+    uint64_t numProposalBatches;
+
+    /**
+     * The number of operations in each batch appended by #proposerThread.
+     */
+    Core::RollingStat proposalBatchSize;
+
+    /**
+     * Batch sizes bucketed by powers of two: entry i counts batches of
+     * 2^i through 2^(i+1)-1 operations.
+     */
+    std::vector<uint64_t> proposalBatchSizeHistogram;
+
+    /**
+     * How long operations waited in the proposal queue before being appended
+     * to the log.
+     */
+    Core::RollingStat proposalQueueNanos;
+
+    /**
+     * Protects #readyPeers and #replicationExiting. This may be acquired
+     * while holding #mutex, but never the other way around, since RPC
+     * completion callbacks take it from the event loop thread.
+     */
+    std::mutex replyMutex;
+
+    /**
+     * Notified when a peer is added to #readyPeers or #replicationExiting is
+     * set.
+     */
+    Core::ConditionVariable replyReady;
+
+    /**
+     * Peers with completed RPCs, waiting for #replicationThreads. A peer may
+     * appear more than once.
+     */
+    std::deque<std::weak_ptr<Peer>> readyPeers;
+
+    /**
+     * Set by exit() to tell #replicationThreads to stop.
+     */
+    bool replicationExiting;
+
+    /**
+     * The number of times a thread in #replicationThreads woke up to process
+     * ready peers, and the number of AppendEntries responses processed that
+     * way. Their ratio shows how many responses each lock handoff covers.
+     */
+    uint64_t numReplicationWakeups;
+    uint64_t numAppendEntriesCompleted;
+
+    /**
+     * The thread that executes diskThreadMain() to flush log entries to
+     * stable storage in the background.
+     */
+    std::thread diskThread;
 
     /**
      * The thread that executes timerThreadMain() to begin new elections
@@ -1690,6 +2322,18 @@ class RaftConsensus {
      */
     std::thread stepDownThread;
 
+    /**
+     * The thread that executes proposerThreadMain() to append queued client
+     * operations to the log in batches.
+     */
+    std::thread proposerThread;
+
+    /**
+     * The threads that execute replicationThreadMain() to process the
+     * responses to every RPC sent to peers.
+     */
+    std::vector<std::thread> replicationThreads;
+
     Invariants invariants;
 
     friend class RaftConsensusInternal::LocalServer;
@@ -31,6 +31,11 @@ namespace RaftConsensusInternal {
 struct Invariants::ConsensusSnapshot {
     explicit ConsensusSnapshot(const RaftConsensus& consensus)
         : stateChangedCount(consensus.stateChanged.notificationCount)
+        , commitChangedCount(0)
+        , publishedCommitIndex(0)
+        , publishedApplicableIndex(0)
+        , publishedTerm(0)
+        , publishedExiting(false)
         , exiting(consensus.exiting)
         , numPeerThreads(consensus.numPeerThreads)
         , lastLogIndex(consensus.log->getLastLogIndex())
@@ -51,9 +56,21 @@ struct Invariants::ConsensusSnapshot {
                                     consensus.log->getLastLogIndex()).term();
         }
 
+        // The commit state has its own lock.
+        std::lock_guard<std::mutex> commitGuard(consensus.commitMutex);
+        commitChangedCount = consensus.commitChanged.notificationCount;
+        publishedCommitIndex = consensus.publishedCommitIndex;
+        publishedApplicableIndex = consensus.publishedApplicableIndex;
+        publishedTerm = consensus.publishedTerm;
+        publishedExiting = consensus.publishedExiting;
     }
 
     uint64_t stateChangedCount;
+    uint64_t commitChangedCount;
+    uint64_t publishedCommitIndex;
+    uint64_t publishedApplicableIndex;
+    uint64_t publishedTerm;
+    bool publishedExiting;
     bool exiting;
     uint32_t numPeerThreads;
     uint64_t lastLogIndex;
@@ -216,6 +233,17 @@ Invariants::checkBasic()
     // Log metadata is updated when the term or vote changes.
     expect(consensus.log->metadata.current_term() == consensus.currentTerm);
     expect(consensus.log->metadata.voted_for() == consensus.votedFor);
+
+    // Threads waiting for commitment only see what's published under
+    // commitMutex, so it must be up to date whenever the Raft lock is free.
+    {
+        std::lock_guard<std::mutex> commitGuard(consensus.commitMutex);
+        expect(consensus.publishedCommitIndex == consensus.commitIndex);
+        expect(consensus.publishedApplicableIndex ==
+               consensus.getLastApplicableIndex());
+        expect(consensus.publishedTerm == consensus.currentTerm);
+        expect(consensus.publishedExiting == consensus.exiting);
+    }
 }
 
 void
@@ -266,6 +294,29 @@ Invariants::checkDelta()
      // a server goes from not caught up to caught up.
     }
 
+    // The published commit state moves the same way.
+    if (previous->publishedExiting)
+        expect(current->publishedExiting);
+    expect(previous->publishedTerm <= current->publishedTerm);
+    expect(previous->publishedCommitIndex <= current->publishedCommitIndex);
+    expect(previous->publishedApplicableIndex <=
+           current->publishedApplicableIndex);
+
+    // Threads waiting for commitment sleep on commitChanged, so changes they
+    // depend on must notify it too:
+    if (previous->commitChangedCount == current->commitChangedCount) {
+        expect(previous->currentTerm == current->currentTerm);
+        expect(previous->state == current->state);
+        expect(previous->commitIndex == current->commitIndex);
+        expect(previous->exiting == current->exiting);
+        expect(previous->publishedCommitIndex ==
+               current->publishedCommitIndex);
+        expect(previous->publishedApplicableIndex ==
+               current->publishedApplicableIndex);
+        expect(previous->publishedTerm == current->publishedTerm);
+        expect(previous->publishedExiting == current->publishedExiting);
+    }
+
     previous = std::move(current);
 }
 
@@ -49,6 +49,9 @@ RaftService::handleRPC(RPC::ServerRPC rpc)
         case OpCode::REQUEST_VOTE:
             requestVote(std::move(rpc));
             break;
+        case OpCode::GET_READ_INDEX:
+            getReadIndex(std::move(rpc));
+            break;
         default:
             WARNING("Client sent request with bad op code (%u) to RaftService",
                     rpc.getOpCode());
@@ -105,6 +108,14 @@ RaftService::requestVote(RPC::ServerRPC rpc)
     rpc.reply(response);
 }
 
+void
+RaftService::getReadIndex(RPC::ServerRPC rpc)
+{
+    PRELUDE(GetReadIndex);
+    globals.raft->handleGetReadIndex(request, response);
+    rpc.reply(response);
+}
+
 
 } // namespace LogCabin::Server
 } // namespace LogCabin
@@ -56,6 +56,13 @@ StateMachine::StateMachine(std::shared_ptr<RaftConsensus> consensus,
             config.read<uint64_t>("snapshotRatio", 4))
     , snapshotWatchdogInterval(std::chrono::milliseconds(
             config.read<uint64_t>("snapshotWatchdogMilliseconds", 10000)))
+    , snapshotInThread(false)
+    , maxEntriesPerApply(std::max(1UL,
+            config.read<uint64_t>("stateMachineMaxEntriesPerApply", 1000)))
+    , checkpointInterval(std::chrono::milliseconds(
+            config.read<uint64_t>("stateMachineCheckpointMilliseconds", 0)))
+    , lastCheckpointAt(TimePoint::min())
+    , lastCheckpointIndex(0)
       // TODO(ongaro): This should be configurable, but it must be the same for
       // every server, so it's dangerous to put it in the config file. Need to
       // use the Raft log to agree on this value. Also need to inform clients
@@ -73,33 +80,51 @@ StateMachine::StateMachine(std::shared_ptr<RaftConsensus> consensus,
     , snapshotCompleted()
     , exiting(false)
     , childPid(0)
+    , snapshotThreadWriting(false)
+    , snapshotAborted(false)
     , lastApplied(0)
     , lastUnknownRequestMessage(TimePoint::min())
     , numUnknownRequests(0)
     , numUnknownRequestsSinceLastMessage(0)
     , numSnapshotsAttempted(0)
     , numSnapshotsFailed(0)
+    , numApplyBatches(0)
+    , numEntriesApplied(0)
+    , lastRestoreKeys(0)
+    , lastRestoreBytes(0)
+    , lastRestoreNanos(0)
     , isSnapshotRequested(false)
     , maySnapshotAt(TimePoint::min())
     , sessions()
     , store(config.read<std::string>("storagePath", "storage") + "/server" +
             std::to_string(static_cast<long long unsigned int>(config.read<uint64_t>("serverId"))) +
-            "/leveldb")
+            "/leveldb", config)
     , writer()
     , applyThread()
     , snapshotThread()
     , snapshotWatchdogThread()
 {
+    std::string snapshotMode =
+        config.read<std::string>("snapshotMode", "fork");
+    if (snapshotMode == "thread") {
+        snapshotInThread = true;
+    } else if (snapshotMode != "fork") {
+        PANIC("Unknown snapshotMode: %s (expected fork or thread)",
+              snapshotMode.c_str());
+    }
+
+    // The store must be ready before applyThread starts using it.
+    if (!store.init()) {
+        PANIC("Init levelDB failed!");
+    }
+    loadAppliedState();
+
     if (!stateMachineSuppressThreads) {
         applyThread = std::thread(&StateMachine::applyThreadMain, this);
         snapshotThread = std::thread(&StateMachine::snapshotThreadMain, this);
         snapshotWatchdogThread = std::thread(
                 &StateMachine::snapshotWatchdogThreadMain, this);
     }
-
-    if (!store.init()) {
-        PANIC("Init levelDB failed!");
-    }
 }
 
 StateMachine::~StateMachine()
@@ -139,13 +164,27 @@ StateMachine::updateServerStats(Protocol::ServerStats& serverStats) const
     serverStats.clear_state_machine();
     Protocol::ServerStats::StateMachine& smStats =
         *serverStats.mutable_state_machine();
-    smStats.set_snapshotting(childPid != 0);
+    smStats.set_snapshotting(isSnapshotInProgress(
+                                Core::HoldingMutex(lockGuard)));
     smStats.set_last_applied(lastApplied);
     smStats.set_num_sessions(sessions.size());
     smStats.set_num_unknown_requests(numUnknownRequests);
     smStats.set_num_snapshots_attempted(numSnapshotsAttempted);
     smStats.set_num_snapshots_failed(numSnapshotsFailed);
+    smStats.set_num_apply_batches(numApplyBatches);
+    smStats.set_num_entries_applied(numEntriesApplied);
+    smStats.set_last_checkpoint_index(lastCheckpointIndex);
     smStats.set_may_snapshot_at(time.unixNanos(maySnapshotAt));
+    if (lastRestoreNanos > 0) {
+        double seconds = double(lastRestoreNanos) / 1e9;
+        smStats.set_last_restore_keys(lastRestoreKeys);
+        smStats.set_last_restore_bytes(lastRestoreBytes);
+        smStats.set_last_restore_nanos(lastRestoreNanos);
+        smStats.set_last_restore_keys_per_second(
+            double(lastRestoreKeys) / seconds);
+        smStats.set_last_restore_mbytes_per_second(
+            double(lastRestoreBytes) / (1024 * 1024) / seconds);
+    }
     store.updateServerStats(*smStats.mutable_store());
 }
 
@@ -206,20 +245,20 @@ bool
 StateMachine::isTakingSnapshot() const
 {
     std::lock_guard<Core::Mutex> lockGuard(mutex);
-    return childPid != 0;
+    return isSnapshotInProgress(Core::HoldingMutex(lockGuard));
 }
 
 void
 StateMachine::startTakingSnapshot()
 {
     std::unique_lock<Core::Mutex> lockGuard(mutex);
-    if (childPid == 0) {
+    if (!isSnapshotInProgress(Core::HoldingMutex(lockGuard))) {
         NOTICE("Administrator requested snapshot");
         isSnapshotRequested = true;
         snapshotSuggested.notify_all();
         // This waits on numSnapshotsAttempted to change, since waiting on
-        // childPid != 0 would risk missing an entire snapshot that started and
-        // completed before this thread was scheduled.
+        // isSnapshotInProgress() would risk missing an entire snapshot that
+        // started and completed before this thread was scheduled.
         uint64_t nextSnapshot = numSnapshotsAttempted + 1;
         while (!exiting && numSnapshotsAttempted < nextSnapshot) {
             snapshotStarted.wait(lockGuard);
@@ -231,11 +270,13 @@ void
 StateMachine::stopTakingSnapshot()
 {
     std::unique_lock<Core::Mutex> lockGuard(mutex);
-    int pid = childPid;
-    if (pid != 0) {
+    if (isSnapshotInProgress(Core::HoldingMutex(lockGuard))) {
         NOTICE("Administrator aborted snapshot");
+        uint64_t current = numSnapshotsAttempted;
         killSnapshotProcess(Core::HoldingMutex(lockGuard), SIGTERM);
-        while (!exiting && pid == childPid) {
+        while (!exiting &&
+               isSnapshotInProgress(Core::HoldingMutex(lockGuard)) &&
+               current == numSnapshotsAttempted) {
             snapshotCompleted.wait(lockGuard);
         }
     }
@@ -329,23 +370,43 @@ StateMachine::applyThreadMain()
     Core::ThreadId::setName("StateMachine");
     try {
         while (true) {
-            RaftConsensus::Entry entry = consensus->getNextEntry(lastApplied);
-            std::lock_guard<Core::Mutex> lockGuard(mutex);
-            switch (entry.type) {
-                case RaftConsensus::Entry::SKIP:
-                    break;
-                case RaftConsensus::Entry::DATA:
-                    apply(entry);
-                    break;
-                case RaftConsensus::Entry::SNAPSHOT:
-                    NOTICE("Loading snapshot through entry %lu into state "
-                           "machine", entry.index);
-                    loadSnapshot(*entry.snapshotReader);
-                    NOTICE("Done loading snapshot");
-                    break;
+            // Drain everything that's committed (up to maxEntriesPerApply)
+            // and apply it as a single store batch with a single sync.
+            std::vector<RaftConsensus::Entry> entries =
+                consensus->getNextEntries(lastApplied, maxEntriesPerApply);
+            std::unique_lock<Core::Mutex> lockGuard(mutex);
+            // SKIP entries don't touch the store, so they needn't be
+            // persisted: replaying them after a restart is harmless.
+            bool persist = false;
+            store.beginBatch();
+            for (auto it = entries.begin(); it != entries.end(); ++it) {
+                RaftConsensus::Entry& entry = *it;
+                switch (entry.type) {
+                    case RaftConsensus::Entry::SKIP:
+                        break;
+                    case RaftConsensus::Entry::DATA:
+                        apply(entry);
+                        persist = true;
+                        break;
+                    case RaftConsensus::Entry::SNAPSHOT:
+                        // always alone in 'entries', so the batch is empty
+                        abortInProcessSnapshot(lockGuard);
+                        NOTICE("Loading snapshot through entry %lu into "
+                               "state machine", entry.index);
+                        loadSnapshot(*entry.snapshotReader);
+                        NOTICE("Done loading snapshot");
+                        persist = true;
+                        break;
+                }
+                expireSessions(entry.clusterTime);
             }
-            expireSessions(entry.clusterTime);
-            lastApplied = entry.index;
+            lastApplied = entries.back().index;
+            if (persist)
+                commitAppliedState();
+            else
+                store.abortBatch();
+            ++numApplyBatches;
+            numEntriesApplied += entries.size();
             entriesApplied.notify_all();
             if (shouldTakeSnapshot(lastApplied) &&
                 maySnapshotAt <= Clock::now()) {
@@ -355,6 +416,12 @@ StateMachine::applyThreadMain()
     } catch (const Core::Util::ThreadInterruptedException&) {
         NOTICE("exiting");
         std::lock_guard<Core::Mutex> lockGuard(mutex);
+        if (lastCheckpointIndex < lastApplied) {
+            // Save a final checkpoint so that a clean restart needn't
+            // re-apply anything.
+            store.beginBatch();
+            commitAppliedState(true);
+        }
         exiting = true;
         entriesApplied.notify_all();
         snapshotSuggested.notify_all();
@@ -383,6 +450,55 @@ StateMachine::serializeSessions(SnapshotStateMachine::Header& header) const
     }
 }
 
+void
+StateMachine::commitAppliedState(bool forceSync)
+{
+    SnapshotStateMachine::AppliedState state;
+    state.set_last_applied(lastApplied);
+    serializeSessions(*state.mutable_header());
+    TimePoint now = Clock::now();
+    bool sync = (forceSync ||
+                 checkpointInterval == std::chrono::nanoseconds::zero() ||
+                 now >= lastCheckpointAt + checkpointInterval);
+    store.commitBatch(state, sync);
+    if (sync) {
+        lastCheckpointAt = now;
+        lastCheckpointIndex = lastApplied;
+    }
+}
+
+void
+StateMachine::loadAppliedState()
+{
+    SnapshotStateMachine::AppliedState state;
+    if (!store.readMetadata(state)) {
+        NOTICE("Store has no applied index recorded; the state machine will "
+               "be rebuilt from the snapshot and log");
+        return;
+    }
+    if (consensus) { // sometimes missing for testing
+        // Entries are only applied once they're committed and durable in
+        // the local log (see RaftConsensus::getLastApplicableIndex()), so
+        // they can't be missing from it unless the log was wiped out from
+        // under the store.
+        SnapshotStats::SnapshotStats stats = consensus->getSnapshotStats();
+        if (state.last_applied() > stats.last_log_index()) {
+            WARNING("Store has applied through entry %lu, but the log only "
+                    "goes up to %lu. Ignoring the store's applied index and "
+                    "rebuilding the state machine from the snapshot and log.",
+                    state.last_applied(),
+                    stats.last_log_index());
+            return;
+        }
+    }
+    loadSessions(state.header());
+    lastApplied = state.last_applied();
+    lastCheckpointIndex = lastApplied;
+    NOTICE("Resuming state machine from entry %lu recorded in the store "
+           "(%lu sessions)",
+           lastApplied, sessions.size());
+}
+
 void
 StateMachine::expireResponses(Session& session, uint64_t firstOutstandingRPC)
 {
@@ -431,9 +547,30 @@ StateMachine::killSnapshotProcess(Core::HoldingMutex holdingMutex,
                     childPid,
                     strerror(errno));
         }
+    } else if (snapshotThreadWriting) {
+        // A thread can't be killed; the best we can do is ask it to stop
+        // between chunks.
+        snapshotAborted = true;
     }
 }
 
+bool
+StateMachine::isSnapshotInProgress(Core::HoldingMutex holdingMutex) const
+{
+    return childPid != 0 || snapshotThreadWriting;
+}
+
+void
+StateMachine::abortInProcessSnapshot(std::unique_lock<Core::Mutex>& lockGuard)
+{
+    if (!snapshotThreadWriting)
+        return;
+    NOTICE("Aborting in-process snapshot before replacing the store");
+    snapshotAborted = true;
+    while (snapshotThreadWriting)
+        snapshotCompleted.wait(lockGuard);
+}
+
 void
 StateMachine::loadSessions(const SnapshotStateMachine::Header& header)
 {
@@ -456,15 +593,16 @@ StateMachine::loadSessions(const SnapshotStateMachine::Header& header)
 void
 StateMachine::loadSnapshot(Core::ProtoBuf::InputStream& stream)
 {
-    // Check that this snapshot uses format version 1
+    // Check that this snapshot uses format version 1 or 2. Version 1 stores
+    // the whole tree in a single message; version 2 streams it in chunks.
     uint8_t formatVersion = 0;
     uint64_t bytesRead = stream.readRaw(&formatVersion, sizeof(formatVersion));
     if (bytesRead < sizeof(formatVersion)) {
         PANIC("Snapshot contents are empty (no format version field)");
     }
-    if (formatVersion != 1) {
+    if (formatVersion != 1 && formatVersion != 2) {
         PANIC("Snapshot contents format version read was %u, but this "
-              "code can only read version 1",
+              "code can only read versions 1 and 2",
               formatVersion);
     }
 
@@ -480,7 +618,15 @@ StateMachine::loadSnapshot(Core::ProtoBuf::InputStream& stream)
     }
 
     // Load the tree's state
-    store.loadSnapshot(stream);
+    TimePoint start = Clock::now();
+    uint64_t startBytes = stream.getBytesRead();
+    lastRestoreKeys = store.loadSnapshot(stream, formatVersion);
+    lastRestoreBytes = stream.getBytesRead() - startBytes;
+    std::chrono::nanoseconds elapsed = Clock::now() - start;
+    lastRestoreNanos = uint64_t(elapsed.count());
+    NOTICE("Restored %lu keys (%lu bytes) into the store in %s",
+           lastRestoreKeys, lastRestoreBytes,
+           Core::StringUtil::toString(elapsed).c_str());
 }
 
 bool
@@ -564,7 +710,8 @@ StateMachine::snapshotWatchdogThreadMain()
         TimePoint waitUntil = TimePoint::max();
         TimePoint now = Clock::now();
 
-        if (childPid > 0) { // there is some child process
+        if (isSnapshotInProgress(Core::HoldingMutex(lockGuard))) {
+            // there is some child process (or in-process snapshot)
             uint64_t currentProgress = *writer->sharedBytesWritten.value;
             if (tracking == numSnapshotsAttempted) { // tracking current child
                 if (snapshotWatchdogInterval != zero &&
@@ -575,7 +722,7 @@ StateMachine::snapshotWatchdogThreadMain()
                               "at all often, you should file a bug to "
                               "understand the root cause.",
                               numSnapshotsAttempted,
-                              childPid,
+                              childPid, // 0 for in-process snapshots
                               toString(snapshotWatchdogInterval).c_str());
                         killSnapshotProcess(Core::HoldingMutex(lockGuard),
                                             SIGKILL);
@@ -598,7 +745,7 @@ StateMachine::snapshotWatchdogThreadMain()
             }
             if (snapshotWatchdogInterval != zero)
                 waitUntil = startTime + snapshotWatchdogInterval;
-        } else { // no child process
+        } else { // no snapshot in progress
             if (tracking != ~0UL) {
                 VERBOSE("Snapshot ended: no longer tracking (counter %lu)",
                         tracking);
@@ -625,6 +772,11 @@ StateMachine::takeSnapshot(uint64_t lastIncludedIndex,
     ++numSnapshotsAttempted;
     snapshotStarted.notify_all();
 
+    if (snapshotInThread) {
+        takeSnapshotInThread(lastIncludedIndex, lockGuard);
+        return;
+    }
+
     pid_t pid = fork();
     if (pid == -1) { // error
         PANIC("Couldn't fork: %s", strerror(errno));
@@ -642,8 +794,8 @@ StateMachine::takeSnapshot(uint64_t lastIncludedIndex,
             }
         }
 
-        // Format version of snapshot contents is 1.
-        uint8_t formatVersion = 1;
+        // Format version of snapshot contents is 2.
+        uint8_t formatVersion = 2;
         writer->writeRaw(&formatVersion, sizeof(formatVersion));
         // StateMachine state comes next
         {
@@ -651,7 +803,8 @@ StateMachine::takeSnapshot(uint64_t lastIncludedIndex,
             serializeSessions(header);
             writer->writeMessage(header);
         }
-        // Then the Tree itself (this one is potentially large)
+        // Then the Tree itself (this one is potentially large, so it is
+        // streamed out in chunks)
         store.dumpSnapshot(*writer);
 
         // Flush the changes to the snapshot file before exiting.
@@ -696,6 +849,55 @@ StateMachine::takeSnapshot(uint64_t lastIncludedIndex,
     }
 }
 
+void
+StateMachine::takeSnapshotInThread(uint64_t lastIncludedIndex,
+                                   std::unique_lock<Core::Mutex>& lockGuard)
+{
+    assert(childPid == 0);
+    snapshotThreadWriting = true;
+    snapshotAborted = false;
+
+    // Capture a consistent view of the state machine while holding the lock:
+    // applyThread can't have applied anything past lastIncludedIndex yet.
+    SnapshotStateMachine::Header header;
+    serializeSessions(header);
+    std::unique_ptr<Store::Store::ReadView> view = store.getReadView();
+
+    bool completed = false;
+    {
+        // Release the lock while streaming out the store so that entries
+        // keep being applied; only the read view is used from here on.
+        Core::MutexUnlock<Core::Mutex> unlockGuard(lockGuard);
+
+        // Format version of snapshot contents is 2.
+        uint8_t formatVersion = 2;
+        writer->writeRaw(&formatVersion, sizeof(formatVersion));
+        writer->writeMessage(header);
+        completed = store.dumpSnapshot(*writer, view.get(), &snapshotAborted);
+        view.reset();
+    }
+
+    snapshotThreadWriting = false;
+    if (completed) {
+        NOTICE("Completed writing state machine contents to snapshot "
+               "staging file");
+        consensus->snapshotDone(lastIncludedIndex, std::move(writer));
+    } else if (exiting) {
+        writer->discard();
+        writer.reset();
+        NOTICE("In-process snapshot aborted since this process is exiting");
+    } else {
+        writer->discard();
+        writer.reset();
+        ++numSnapshotsFailed;
+        ERROR("In-process snapshot was aborted. This server will try again. "
+              "%lu of %lu snapshots have failed in total.",
+              numSnapshotsFailed,
+              numSnapshotsAttempted);
+    }
+    snapshotCompleted.notify_all();
+}
+
 void
 StateMachine::warnUnknownRequest(
         const google::protobuf::Message& request,
@@ -14,6 +14,7 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <atomic>
 #include <memory>
 #include <mutex>
 #include <thread>
@@ -132,7 +133,9 @@ class StateMachine {
     typedef Clock::time_point TimePoint;
 
     /**
-     * Invoked once per committed entry from the Raft log.
+     * Invoked once per committed entry from the Raft log. The entry's writes
+     * are staged into the store's current batch; applyThreadMain() commits
+     * the batch once all the entries it fetched have been applied.
      */
     void apply(const RaftConsensus::Entry& entry);
 
@@ -147,6 +150,22 @@ class StateMachine {
      */
     void serializeSessions(SnapshotStateMachine::Header& header) const;
 
+    /**
+     * Commit the store's current batch of writes together with #lastApplied
+     * and the #sessions table, so that they are persisted atomically.
+     * The write is synced (a checkpoint) unless #checkpointInterval is set
+     * and hasn't elapsed since the last checkpoint.
+     * \param forceSync
+     *      If true, always sync.
+     */
+    void commitAppliedState(bool forceSync = false);
+
+    /**
+     * Called from the constructor to resume from the applied index and
+     * sessions last committed to the store, if any.
+     */
+    void loadAppliedState();
+
     /**
      * Update the session and clean up unnecessary responses.
      * \param session
@@ -166,10 +185,24 @@ class StateMachine {
 
     /**
      * If there is a current snapshot process, send it a signal and return
-     * immediately.
+     * immediately. If a snapshot is instead being written in-process (see
+     * #snapshotInThread), ask it to stop at its next opportunity.
      */
     void killSnapshotProcess(Core::HoldingMutex holdingMutex, int signum);
 
+    /**
+     * Return true if a snapshot is being written, either by a child process
+     * or by snapshotThread itself.
+     */
+    bool isSnapshotInProgress(Core::HoldingMutex holdingMutex) const;
+
+    /**
+     * If a snapshot is being written in-process, abort it and wait for
+     * snapshotThread to finish with it. Used before the store is replaced,
+     * since the in-process snapshot reads from the live store.
+     */
+    void abortInProcessSnapshot(std::unique_lock<Core::Mutex>& lockGuard);
+
     /**
      * Restore the #sessions table from a snapshot.
      */
@@ -207,6 +240,15 @@ class StateMachine {
     void takeSnapshot(uint64_t lastIncludedIndex,
                       std::unique_lock<Core::Mutex>& lockGuard);
 
+    /**
+     * Called by takeSnapshot to write the snapshot from snapshotThread
+     * without forking. The sessions and a read view of the store are captured
+     * while holding the lock; the store is then streamed out from that view
+     * with the lock released, so that entries keep being applied meanwhile.
+     */
+    void takeSnapshotInThread(uint64_t lastIncludedIndex,
+                              std::unique_lock<Core::Mutex>& lockGuard);
+
     /**
      * Called to log a debug message if appropriate when the state machine
      * encounters a query or command that is not understood by the current
@@ -257,6 +299,42 @@ class StateMachine {
      */
     std::chrono::nanoseconds snapshotWatchdogInterval;
 
+    /**
+     * If true, snapshots are written by snapshotThread from a consistent
+     * levelDB read view instead of by a forked child process. This avoids the
+     * copy-on-write cost of fork() in a large, busy process.
+     */
+    bool snapshotInThread;
+
+    /**
+     * The maximum number of committed entries that applyThread applies as a
+     * single store batch (with a single sync). Larger values give higher
+     * apply throughput but hold #mutex for longer.
+     */
+    uint64_t maxEntriesPerApply;
+
+    /**
+     * If zero, every batch of applied entries is synced to disk. Otherwise,
+     * batches are written to the store without syncing, and a synced
+     * checkpoint is made at most this often. This relies on the Raft log
+     * being durable: after a crash, the store comes back as of some earlier
+     * batch (with the matching applied index), and the missing suffix is
+     * applied again from the log.
+     */
+    std::chrono::nanoseconds checkpointInterval;
+
+    /**
+     * The time of the last synced write to the store (see
+     * #checkpointInterval).
+     */
+    TimePoint lastCheckpointAt;
+
+    /**
+     * The applied index written by the last synced write to the store. The
+     * store is known to be durable through this entry.
+     */
+    uint64_t lastCheckpointIndex;
+
     /**
      * The time interval after which to remove an inactive client session, in
      * nanoseconds of cluster time.
@@ -320,11 +398,27 @@ class StateMachine {
      */
     pid_t childPid;
 
+    /**
+     * Set while snapshotThread is writing a snapshot in-process (see
+     * #snapshotInThread). This plays the role of a non-zero #childPid for
+     * snapshots that do not fork; the two are never set at the same time.
+     */
+    bool snapshotThreadWriting;
+
+    /**
+     * Set to ask an in-process snapshot to stop early; it is polled while the
+     * store is being streamed out. This is the in-process counterpart of
+     * signalling the child process. Reset when each snapshot starts.
+     */
+    std::atomic<bool> snapshotAborted;
+
     /**
      * The index of the last log entry that this state machine has applied.
      * This variable is only written to by applyThread, so applyThread is free
      * to access this variable without holding 'mutex'. Other readers must hold
      * 'mutex'.
+     * It is persisted in the store along with the entries' effects (see
+     * commitAppliedState()), and restored from there upon restart.
      */
     uint64_t lastApplied;
 
@@ -361,6 +455,30 @@ class StateMachine {
      */
     uint64_t numSnapshotsFailed;
 
+    /**
+     * The number of store batches applyThread has applied, and the number of
+     * entries they covered. Their ratio is the average apply batch size.
+     */
+    uint64_t numApplyBatches;
+    uint64_t numEntriesApplied;
+
+    /**
+     * The number of keys restored into the store by the most recent
+     * loadSnapshot(). Reported with #lastRestoreBytes and #lastRestoreNanos
+     * as restore throughput in the server stats.
+     */
+    uint64_t lastRestoreKeys;
+
+    /**
+     * The number of snapshot bytes read by the most recent store restore.
+     */
+    uint64_t lastRestoreBytes;
+
+    /**
+     * How long the most recent store restore took, in nanoseconds.
+     */
+    uint64_t lastRestoreNanos;
+
     /**
      * Set to true when an administrator has asked the server to take a
      * snapshot; set to false once the server starts any snapshot.
@@ -420,8 +538,9 @@ class StateMachine {
 
     /**
      * The file that the snapshot is being written into. Also used by to track
-     * the progress of the child process for the watchdog thread.
-     * This is non-empty if and only if childPid > 0.
+     * the progress of the child process (or in-process snapshot) for the
+     * watchdog thread.
+     * This is non-empty if and only if isSnapshotInProgress().
      */
     std::unique_ptr<Storage::SnapshotFile::Writer> writer;
 
@@ -438,9 +557,10 @@ class StateMachine {
 
     /**
      * Watches the child process to make sure it's writing to #writer, and
-     * kills it otherwise. This is to detect any possible deadlock that might
-     * occur if a thread in the parent at the time of the fork held a lock that
-     * the child process then tried to access.
+     * kills it otherwise (in-process snapshots are asked to abort instead).
+     * This is to detect any possible deadlock that might occur if a thread in
+     * the parent at the time of the fork held a lock that the child process
+     * then tried to access.
      * See https://github.com/logcabin/logcabin/issues/121 for more rationale.
      */
     std::thread snapshotWatchdogThread;
@@ -76,6 +76,15 @@ class Log {
      */
     typedef Protocol::Raft::Entry Entry;
 
+    /**
+     * A reference-counted, immutable log entry. The log holds its entries
+     * this way so that replication and the state machine can share an
+     * entry's payload without copying it, even after the log has moved on.
+     * Entries must not be modified once shared; serializing them (which
+     * updates protobuf's cached sizes) is only done under the Raft lock.
+     */
+    typedef std::shared_ptr<const Entry> EntryPtr;
+
     Log();
     virtual ~Log();
 
@@ -83,12 +92,14 @@ class Log {
      * Start to append new entries to the log. The entries may not be on disk
      * yet when this returns; see Sync.
      * \param entries
-     *      Entries to place at the end of the log.
+     *      Entries to place at the end of the log. The log keeps these
+     *      references rather than copying the entries. Entries should already
+     *      have their index set; those that don't are copied to set it.
      * \return
      *      Range of indexes of the new entries in the log, inclusive.
      */
     virtual std::pair<uint64_t, uint64_t> append(
-                            const std::vector<const Entry*>& entries) = 0;
+                            const std::vector<EntryPtr>& entries) = 0;
 
     /**
      * Look up an entry by its log index.
@@ -97,10 +108,46 @@ class Log {
      *      Otherwise, this will crash the server.
      * \return
      *      The entry corresponding to that index. This reference is only
-     *      guaranteed to be valid until the next time the log is modified.
+     *      guaranteed to be valid until the next call into the log, since
+     *      logs may drop entries from memory that they can read back later.
+     *      Use getEntryPtr() to hold on to an entry for longer.
      */
     virtual const Entry& getEntry(uint64_t index) const = 0;
 
+    /**
+     * Look up an entry by its log index, sharing ownership of it.
+     * \param index
+     *      Must be in the range [getLogStartIndex(), getLastLogIndex()].
+     *      Otherwise, this will crash the server.
+     * \return
+     *      The entry corresponding to that index, which remains valid for as
+     *      long as the caller holds on to it.
+     */
+    virtual EntryPtr getEntryPtr(uint64_t index) const = 0;
+
+    /**
+     * Look up the term of an entry by its log index. This is the same as
+     * getEntry(index).term(), but logs that don't keep every entry in memory
+     * may be able to answer it without reading the entry back in.
+     * \param index
+     *      Must be in the range [getLogStartIndex(), getLastLogIndex()].
+     *      Otherwise, this will crash the server.
+     */
+    virtual uint64_t getEntryTerm(uint64_t index) const {
+        return getEntry(index).term();
+    }
+
+    /**
+     * Look up the type of an entry by its log index. This is the same as
+     * getEntry(index).type(); see getEntryTerm().
+     * \param index
+     *      Must be in the range [getLogStartIndex(), getLastLogIndex()].
+     *      Otherwise, this will crash the server.
+     */
+    virtual Protocol::Raft::EntryType getEntryType(uint64_t index) const {
+        return getEntry(index).type();
+    }
+
     /**
      * Get the index of the first entry in the log (whether or not this
      * entry exists).
@@ -43,18 +43,25 @@ MemoryLog::~MemoryLog()
 }
 
 std::pair<uint64_t, uint64_t>
-MemoryLog::append(const std::vector<const Entry*>& newEntries)
+MemoryLog::append(const std::vector<EntryPtr>& newEntries)
 {
     uint64_t firstIndex = startIndex + entries.size();
     uint64_t lastIndex = firstIndex + newEntries.size() - 1;
     for (auto it = newEntries.begin(); it != newEntries.end(); ++it)
-        entries.push_back(**it);
+        entries.push_back(*it);
     currentSync->lastIndex = lastIndex;
     return {firstIndex, lastIndex};
 }
 
 const Log::Entry&
 MemoryLog::getEntry(uint64_t index) const
+{
+    uint64_t offset = index - startIndex;
+    return *entries.at(offset);
+}
+
+Log::EntryPtr
+MemoryLog::getEntryPtr(uint64_t index) const
 {
     uint64_t offset = index - startIndex;
     return entries.at(offset);
@@ -85,7 +92,7 @@ MemoryLog::getSizeBytes() const
     // TODO(ongaro): keep this pre-calculated for efficiency
     uint64_t size = 0;
     for (auto it = entries.begin(); it < entries.end(); ++it)
-        size += uint64_t(it->ByteSize());
+        size += uint64_t((*it)->ByteSize());
     return size;
 }
 
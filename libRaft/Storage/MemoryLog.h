@@ -35,8 +35,9 @@ class MemoryLog : public Log {
     ~MemoryLog();
 
     std::pair<uint64_t, uint64_t>
-    append(const std::vector<const Entry*>& entries);
+    append(const std::vector<EntryPtr>& entries);
     const Entry& getEntry(uint64_t logIndex) const;
+    EntryPtr getEntryPtr(uint64_t logIndex) const;
     uint64_t getLogStartIndex() const;
     uint64_t getLastLogIndex() const;
     std::string getName() const;
@@ -60,7 +61,7 @@ class MemoryLog : public Log {
      * This is a deque rather than a vector to support fast prefix truncation
      * (used after snapshotting a prefix of the log).
      */
-    std::deque<Entry> entries;
+    std::deque<EntryPtr> entries;
 
     /**
      * This is returned by the next call to getSync.
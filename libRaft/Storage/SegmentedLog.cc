@@ -18,6 +18,7 @@
 #include <endian.h>
 
 #include <algorithm>
+#include <set>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -55,6 +56,11 @@ namespace {
  */
 #define CLOSED_SEGMENT_FORMAT "%020lu-%020lu"
 
+/**
+ * Appended to a closed segment's filename to name its index file.
+ */
+#define SEGMENT_INDEX_SUFFIX ".index"
+
 /**
  * Return true if all the bytes in range [start, start + length) are zero.
  */
@@ -274,6 +280,21 @@ SegmentedLog::Sync::wait()
                 ++unlinks;
                 break;
             }
+            case Op::WRITE_FILE: {
+                FS::File out = FS::openFile(f, op.filename1,
+                                            O_CREAT|O_WRONLY|O_TRUNC);
+                ssize_t written = FS::write(out.fd,
+                        op.writeData.getData(),
+                        op.writeData.getLength());
+                if (written < 0) {
+                    PANIC("Failed to write to %s: %s",
+                          out.path.c_str(),
+                          strerror(errno));
+                }
+                ++writes;
+                totalBytesWritten += op.writeData.getLength();
+                break;
+            }
             case Op::NOOP: {
                 break;
             }
@@ -317,7 +338,19 @@ SegmentedLog::Sync::updateStats(Core::RollingStat& nanos) const
 SegmentedLog::Segment::Record::Record(uint64_t offset)
     : offset(offset)
     , entry()
+    , term(0)
+    , type(Protocol::Raft::EntryType::UNKNOWN)
+    , cached(false)
+    , lruPosition()
+{
+}
+
+void
+SegmentedLog::Segment::Record::setEntry(Log::EntryPtr newEntry)
 {
+    term = newEntry->term();
+    type = newEntry->type();
+    entry = std::move(newEntry);
 }
 
 
@@ -330,6 +363,7 @@ SegmentedLog::Segment::Segment()
     , bytes(0)
     , filename("--invalid--")
     , entries()
+    , readableAfterSync(0)
 {
 }
 
@@ -340,6 +374,12 @@ SegmentedLog::Segment::makeClosedFilename() const
                   startIndex, endIndex);
 }
 
+std::string
+SegmentedLog::Segment::makeIndexFilename() const
+{
+    return filename + SEGMENT_INDEX_SUFFIX;
+}
+
 ////////// SegmentedLog public functions //////////
 
 
@@ -362,6 +402,20 @@ SegmentedLog::SegmentedLog(const FS::File& parentDir,
     , logStartIndex(1)
     , segmentsByStartIndex()
     , totalClosedSegmentBytes(0)
+    , entryCacheBudget(config.read<uint64_t>("storageEntryCacheBytes",
+                                             64 * 1024 * 1024))
+    , entryCacheLru()
+    , entryCacheBytes(0)
+    , numEntryCacheHits(0)
+    , numEntryCacheMisses(0)
+    , numEntryCacheEvictions(0)
+    , segmentReaderFile()
+    , segmentReader()
+    , segmentReaderStartIndex(0)
+    , syncsTaken(0)
+    , syncsCompleted(0)
+    , closingSegments()
+    , startupLoadNanos(0)
     , preparedSegments(
         std::max(config.read<uint64_t>("storageOpenSegments", 3),
                  1UL))
@@ -405,25 +459,17 @@ SegmentedLog::SegmentedLog(const FS::File& parentDir,
 
 
     // Read data from segments, closing any open segments.
-    for (auto it = segments.begin(); it != segments.end(); ++it) {
-        Segment& segment = *it;
-        bool keep = segment.isOpen ? loadOpenSegment(segment, logStartIndex)
-                                   : loadClosedSegment(segment, logStartIndex);
-        if (keep) {
-            assert(!segment.isOpen);
-            uint64_t startIndex = segment.startIndex;
-            std::string filename = segment.filename;
-            auto result = segmentsByStartIndex.insert({startIndex,
-                                                       std::move(segment)});
-            if (!result.second) {
-                Segment& other = result.first->second;
-                PANIC("Two segments contain entry %lu: %s and %s",
-                      startIndex,
-                      other.filename.c_str(),
-                      filename.c_str());
-            }
-        }
-    }
+    TimePoint loadStart = Clock::now();
+    loadSegments(segments,
+                 std::max(config.read<uint64_t>("storageLoadThreads", 4),
+                          1UL));
+    startupLoadNanos = uint64_t(std::chrono::nanoseconds(
+        Clock::now() - loadStart).count());
+    NOTICE("Loaded %lu segments (%lu bytes) in %s",
+           segmentsByStartIndex.size(),
+           totalClosedSegmentBytes,
+           Core::StringUtil::toString(
+               std::chrono::nanoseconds(startupLoadNanos)).c_str());
 
     // Check to make sure no entry is present in more than one segment,
     // and that there's no gap in the numbering for entries we have.
@@ -488,7 +534,7 @@ SegmentedLog::~SegmentedLog()
 }
 
 std::pair<uint64_t, uint64_t>
-SegmentedLog::append(const std::vector<const Entry*>& entries)
+SegmentedLog::append(const std::vector<EntryPtr>& entries)
 {
     Segment* openSegment = &getOpenSegment();
     uint64_t startIndex = openSegment->endIndex + 1;
@@ -496,13 +542,15 @@ SegmentedLog::append(const std::vector<const Entry*>& entries)
     for (auto it = entries.begin(); it != entries.end(); ++it) {
         Segment::Record record(openSegment->bytes);
         // Note that record.offset may change later, if this entry doesn't fit.
-        record.entry = **it;
-        if (record.entry.has_index()) {
-            assert(index == record.entry.index());
+        if ((*it)->has_index()) {
+            assert(index == (*it)->index());
+            record.setEntry(*it);
         } else {
-            record.entry.set_index(index);
+            std::shared_ptr<Entry> copy = std::make_shared<Entry>(**it);
+            copy->set_index(index);
+            record.setEntry(std::move(copy));
         }
-        Core::Buffer buf = serializeProto(record.entry);
+        Core::Buffer buf = serializeProto(*record.entry);
 
         // See if we need to roll over to a new head segment. If someone is
         // writing an entry that is bigger than MAX_SEGMENT_SIZE, just put it
@@ -535,11 +583,19 @@ SegmentedLog::append(const std::vector<const Entry*>& entries)
             currentSync->ops.emplace_back(dir.fd, Sync::Op::RENAME);
             currentSync->ops.back().filename1 = openSegment->filename;
             currentSync->ops.back().filename2 = newFilename;
-            currentSync->ops.emplace_back(dir.fd, Sync::Op::FSYNC);
             openSegment->filename = newFilename;
+            currentSync->ops.emplace_back(dir.fd, Sync::Op::WRITE_FILE);
+            currentSync->ops.back().filename1 =
+                openSegment->makeIndexFilename();
+            currentSync->ops.back().writeData =
+                makeSegmentIndex(*openSegment);
+            currentSync->ops.emplace_back(dir.fd, Sync::Op::FSYNC);
 
-            // Bookkeeping.
+            // Bookkeeping. The segment's entries can't be evicted until the
+            // file has been written and renamed.
             openSegment->isOpen = false;
+            openSegment->readableAfterSync = syncsTaken + 1;
+            closingSegments.push_back(openSegment->startIndex);
             totalClosedSegmentBytes += openSegment->bytes;
 
             // Open new segment.
@@ -574,18 +630,49 @@ SegmentedLog::append(const std::vector<const Entry*>& entries)
 const SegmentedLog::Entry&
 SegmentedLog::getEntry(uint64_t index) const
 {
-    if (index < getLogStartIndex() ||
-        index > getLastLogIndex()) {
-        PANIC("Attempted to access entry %lu outside of log "
-              "(start index is %lu, last index is %lu)",
-              index, getLogStartIndex(), getLastLogIndex());
+    return *getEntryPtr(index);
+}
+
+SegmentedLog::EntryPtr
+SegmentedLog::getEntryPtr(uint64_t index) const
+{
+    const Segment& segment = getSegment(index);
+    uint64_t i = index - segment.startIndex;
+    const Segment::Record& record = segment.entries.at(i);
+    if (record.cached) {
+        ++numEntryCacheHits;
+        entryCacheLru.splice(entryCacheLru.begin(),
+                             entryCacheLru,
+                             record.lruPosition);
+        return record.entry;
     }
-    auto it = segmentsByStartIndex.upper_bound(index);
-    --it;
-    const Segment& segment = it->second;
-    assert(segment.startIndex <= index);
-    assert(index <= segment.endIndex);
-    return segment.entries.at(index - segment.startIndex).entry;
+    if (record.entry)
+        return record.entry;
+
+    // The entry was evicted; read it back in.
+    ++numEntryCacheMisses;
+    EntryPtr entry = readEntry(segment, i);
+    record.entry = entry;
+    record.cached = true;
+    entryCacheLru.push_front(index);
+    record.lruPosition = entryCacheLru.begin();
+    entryCacheBytes += getRecordBytes(segment, i);
+    evictEntries();
+    return entry;
+}
+
+uint64_t
+SegmentedLog::getEntryTerm(uint64_t index) const
+{
+    const Segment& segment = getSegment(index);
+    return segment.entries.at(index - segment.startIndex).term;
+}
+
+Protocol::Raft::EntryType
+SegmentedLog::getEntryType(uint64_t index) const
+{
+    const Segment& segment = getSegment(index);
+    return segment.entries.at(index - segment.startIndex).type;
 }
 
 uint64_t
@@ -628,6 +715,7 @@ SegmentedLog::takeSync()
             new SegmentedLog::Sync(getLastLogIndex(),
                                    diskWriteDurationThreshold));
     std::swap(other, currentSync);
+    ++syncsTaken;
     return std::move(other);
 }
 
@@ -636,6 +724,8 @@ SegmentedLog::syncCompleteVirtual(std::unique_ptr<Log::Sync> sync)
 {
     static_cast<SegmentedLog::Sync*>(sync.get())->
         updateStats(filesystemOpsNanos);
+    ++syncsCompleted;
+    cacheClosingSegments();
 }
 
 void
@@ -663,8 +753,13 @@ SegmentedLog::truncatePrefix(uint64_t newStartIndex)
             currentSync->ops.emplace_back(openSegmentFile.release(),
                                           Sync::Op::CLOSE);
         } else {
+            currentSync->ops.emplace_back(dir.fd, Sync::Op::UNLINKAT);
+            currentSync->ops.back().filename1 = segment.makeIndexFilename();
             totalClosedSegmentBytes -= segment.bytes;
         }
+        if (segment.startIndex == segmentReaderStartIndex)
+            closeSegmentReader();
+        uncacheEntries(segment, 0);
         segmentsByStartIndex.erase(segmentsByStartIndex.begin());
     }
 
@@ -683,6 +778,7 @@ SegmentedLog::truncateSuffix(uint64_t newEndIndex)
 
     NOTICE("Truncating log to end at index %lu (was %lu)",
            newEndIndex, getLastLogIndex());
+    closeSegmentReader();
     { // Check if the open segment has some entries we need. If so,
       // just truncate that segment, open a new one, and return.
         Segment& openSegment = getOpenSegment();
@@ -718,14 +814,17 @@ SegmentedLog::truncateSuffix(uint64_t newEndIndex)
         if (segment.startIndex > newEndIndex) { // remove segment
             NOTICE("Removing closed segment %s", segment.filename.c_str());
             FS::removeFile(dir, segment.filename);
+            FS::removeFile(dir, segment.makeIndexFilename());
             FS::fsync(dir);
             totalClosedSegmentBytes -= segment.bytes;
+            uncacheEntries(segment, 0);
             segmentsByStartIndex.erase(segment.startIndex);
         } else if (segment.endIndex > newEndIndex) { // truncate segment
             // Update in-memory segment
             uint64_t i = newEndIndex + 1 - segment.startIndex;
             uint64_t newBytes = segment.entries.at(i).offset;
             totalClosedSegmentBytes -= (segment.bytes - newBytes);
+            uncacheEntries(segment, i);
             segment.bytes = newBytes;
             segment.entries.erase(
                 segment.entries.begin() + int64_t(i),
@@ -737,6 +836,7 @@ SegmentedLog::truncateSuffix(uint64_t newEndIndex)
             NOTICE("Truncating closed segment (was %s, renaming to %s)",
                    segment.filename.c_str(),
                    newFilename.c_str());
+            FS::removeFile(dir, segment.makeIndexFilename());
             FS::rename(dir, segment.filename,
                        dir, newFilename);
             FS::fsync(dir);
@@ -746,6 +846,7 @@ SegmentedLog::truncateSuffix(uint64_t newEndIndex)
             FS::File f = FS::openFile(dir, segment.filename, O_WRONLY);
             FS::truncate(f, segment.bytes);
             FS::fsync(f);
+            writeSegmentIndex(segment);
         }
     }
 
@@ -808,6 +909,24 @@ SegmentedLog::updateServerStats(Protocol::ServerStats& serverStats) const
     stats.set_metadata_version(metadata.version());
     metadataWriteNanos.updateProtoBuf(*stats.mutable_metadata_write_nanos());
     filesystemOpsNanos.updateProtoBuf(*stats.mutable_filesystem_ops_nanos());
+    stats.set_startup_load_nanos(startupLoadNanos);
+    stats.set_entry_cache_hits(numEntryCacheHits);
+    stats.set_entry_cache_misses(numEntryCacheMisses);
+    stats.set_entry_cache_evictions(numEntryCacheEvictions);
+    stats.set_entry_cache_entries(entryCacheLru.size());
+    stats.set_entry_cache_bytes(entryCacheBytes);
+    uint64_t residentBytes = entryCacheBytes + getOpenSegment().bytes;
+    for (auto it = closingSegments.begin();
+         it != closingSegments.end();
+         ++it) {
+        auto s = segmentsByStartIndex.find(*it);
+        if (s != segmentsByStartIndex.end() &&
+            !s->second.isOpen &&
+            s->second.readableAfterSync > syncsCompleted) {
+            residentBytes += s->second.bytes;
+        }
+    }
+    stats.set_resident_entry_bytes(residentBytes);
 }
 
 
@@ -819,6 +938,7 @@ SegmentedLog::readSegmentFilenames()
 {
     std::vector<Segment> segments;
     std::vector<std::string> filenames = FS::ls(dir);
+    std::vector<std::string> indexFilenames;
     // sorting isn't strictly necessary, but it helps with unit tests
     std::sort(filenames.begin(), filenames.end());
     for (auto it = filenames.begin(); it != filenames.end(); ++it) {
@@ -827,6 +947,10 @@ SegmentedLog::readSegmentFilenames()
             filename == "metadata2") {
             continue;
         }
+        if (Core::StringUtil::endsWith(filename, SEGMENT_INDEX_SUFFIX)) {
+            indexFilenames.push_back(filename);
+            continue;
+        }
         Segment segment;
         segment.filename = filename;
         segment.bytes = 0;
@@ -869,6 +993,25 @@ SegmentedLog::readSegmentFilenames()
                 filename.c_str(),
                 (dir.path + "/" + filename).c_str());
     }
+
+    // Remove index files left behind by segments that were removed or
+    // renamed (this can happen if the server crashed in between).
+    std::set<std::string> expectedIndexFilenames;
+    for (auto it = segments.begin(); it != segments.end(); ++it) {
+        if (!it->isOpen)
+            expectedIndexFilenames.insert(it->makeIndexFilename());
+    }
+    bool removed = false;
+    for (auto it = indexFilenames.begin(); it != indexFilenames.end(); ++it) {
+        if (expectedIndexFilenames.find(*it) == expectedIndexFilenames.end()) {
+            NOTICE("Removing index file with no matching segment: %s",
+                   it->c_str());
+            FS::removeFile(dir, *it);
+            removed = true;
+        }
+    }
+    if (removed)
+        FS::fsync(dir);
     return segments;
 }
 
@@ -906,6 +1049,105 @@ SegmentedLog::readMetadata(const std::string& filename,
     }
 }
 
+void
+SegmentedLog::loadSegments(std::vector<Segment>& segments,
+                           uint64_t numThreads)
+{
+    std::vector<Segment*> closedSegments;
+    std::vector<Segment*> openSegments;
+    for (auto it = segments.begin(); it != segments.end(); ++it) {
+        if (it->isOpen)
+            openSegments.push_back(&*it);
+        else
+            closedSegments.push_back(&*it);
+    }
+    std::sort(closedSegments.begin(), closedSegments.end(),
+              [](const Segment* a, const Segment* b) {
+                  return a->startIndex < b->startIndex;
+              });
+
+    // Closed segments are loaded by a pool of threads but added to the log
+    // in order. The loaders stay at most 'window' segments ahead of that, so
+    // that the entry cache keeps memory bounded during startup too.
+    const uint64_t window = 2 * numThreads;
+    Core::Mutex mutex;
+    Core::ConditionVariable changed;
+    uint64_t nextToLoad = 0;
+    uint64_t nextToAdd = 0;
+    std::vector<bool> loaded(closedSegments.size(), false);
+    std::vector<bool> keep(closedSegments.size(), false);
+    auto loaderMain = [&]() {
+        Core::ThreadId::setName("SegmentLoader");
+        std::unique_lock<Core::Mutex> lockGuard(mutex);
+        while (true) {
+            while (nextToLoad < closedSegments.size() &&
+                   nextToLoad >= nextToAdd + window) {
+                changed.wait(lockGuard);
+            }
+            if (nextToLoad == closedSegments.size())
+                return;
+            uint64_t i = nextToLoad;
+            ++nextToLoad;
+            lockGuard.unlock();
+            bool k = loadClosedSegment(*closedSegments.at(i), logStartIndex);
+            lockGuard.lock();
+            keep.at(i) = k;
+            loaded.at(i) = true;
+            changed.notify_all();
+        }
+    };
+    std::vector<std::thread> loaders;
+    numThreads = std::min(numThreads, uint64_t(closedSegments.size()));
+    for (uint64_t i = 0; i < numThreads; ++i)
+        loaders.emplace_back(loaderMain);
+    for (uint64_t i = 0; i < closedSegments.size(); ++i) {
+        {
+            std::unique_lock<Core::Mutex> lockGuard(mutex);
+            while (!loaded.at(i))
+                changed.wait(lockGuard);
+        }
+        if (keep.at(i))
+            addLoadedSegment(std::move(*closedSegments.at(i)));
+        {
+            std::lock_guard<Core::Mutex> lockGuard(mutex);
+            nextToAdd = i + 1;
+            changed.notify_all();
+        }
+    }
+    for (auto it = loaders.begin(); it != loaders.end(); ++it)
+        it->join();
+
+    // Open segments may need crash recovery, which truncates and renames
+    // them; do these one at a time as before.
+    for (auto it = openSegments.begin(); it != openSegments.end(); ++it) {
+        Segment& segment = **it;
+        if (loadOpenSegment(segment, logStartIndex))
+            addLoadedSegment(std::move(segment));
+    }
+}
+
+void
+SegmentedLog::addLoadedSegment(Segment segment)
+{
+    assert(!segment.isOpen);
+    uint64_t startIndex = segment.startIndex;
+    std::string filename = segment.filename;
+    auto result = segmentsByStartIndex.insert({startIndex,
+                                               std::move(segment)});
+    if (!result.second) {
+        Segment& other = result.first->second;
+        PANIC("Two segments contain entry %lu: %s and %s",
+              startIndex,
+              other.filename.c_str(),
+              filename.c_str());
+    }
+    totalClosedSegmentBytes += result.first->second.bytes;
+    // Keep memory bounded while loading, rather than holding on to every
+    // entry until the end.
+    cacheEntries(result.first->second);
+    evictEntries();
+}
+
 bool
 SegmentedLog::loadClosedSegment(Segment& segment, uint64_t logStartIndex)
 {
@@ -936,20 +1178,25 @@ SegmentedLog::loadClosedSegment(Segment& segment, uint64_t logStartIndex)
                logStartIndex,
                segment.filename.c_str());
         FS::removeFile(dir, segment.filename);
+        FS::removeFile(dir, segment.makeIndexFilename());
         FS::fsync(dir);
         return false;
     }
 
+    bool indexed = loadSegmentIndex(segment, reader.getFileLength());
+    if (indexed)
+        offset = segment.bytes;
     for (uint64_t index = segment.startIndex;
-         index <= segment.endIndex;
+         !indexed && index <= segment.endIndex;
          ++index) {
         std::string error;
         if (offset >= reader.getFileLength()) {
             error = "File too short";
         } else {
             segment.entries.emplace_back(offset);
-            error = readProtoFromFile(file, reader, &offset,
-                                      &segment.entries.back().entry);
+            std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+            error = readProtoFromFile(file, reader, &offset, entry.get());
+            segment.entries.back().setEntry(std::move(entry));
         }
         if (!error.empty()) {
             PANIC("Could not read entry %lu in log segment %s "
@@ -972,7 +1219,68 @@ SegmentedLog::loadClosedSegment(Segment& segment, uint64_t logStartIndex)
         FS::fsync(file);
     }
     segment.bytes = offset;
-    totalClosedSegmentBytes += segment.bytes;
+    if (!indexed)
+        writeSegmentIndex(segment);
+    return true;
+}
+
+bool
+SegmentedLog::loadSegmentIndex(Segment& segment, uint64_t fileLength) const
+{
+    assert(segment.entries.empty());
+    FS::File file = FS::tryOpenFile(dir, segment.makeIndexFilename(),
+                                    O_RDONLY);
+    if (file.fd < 0) {
+        NOTICE("No index file for segment %s, reading all of its entries",
+               segment.filename.c_str());
+        return false;
+    }
+    FS::FileContents reader(file);
+    uint64_t offset = 0;
+    SegmentedLogMetadata::SegmentIndex index;
+    std::string error = readProtoFromFile(file, reader, &offset, &index);
+    if (error.empty()) {
+        uint64_t numEntries = segment.endIndex + 1 - segment.startIndex;
+        if (index.start_index() != segment.startIndex ||
+            index.end_index() != segment.endIndex) {
+            error = "Index describes a different segment";
+        } else if (uint64_t(index.offset_size()) != numEntries ||
+                   uint64_t(index.term_size()) != numEntries ||
+                   uint64_t(index.type_size()) != numEntries) {
+            error = "Index has the wrong number of entries";
+        } else if (index.bytes() > fileLength) {
+            error = format("Index describes %lu bytes but segment file is "
+                           "only %lu bytes", index.bytes(), fileLength);
+        } else {
+            uint64_t lastOffset = 0;
+            for (uint64_t i = 0; i < numEntries; ++i) {
+                uint64_t o = index.offset(int(i));
+                if ((i == 0 && o != sizeof(SegmentHeader)) ||
+                    (i > 0 && o <= lastOffset) ||
+                    o >= index.bytes()) {
+                    error = format("Bad offset for entry %lu",
+                                   segment.startIndex + i);
+                    break;
+                }
+                lastOffset = o;
+            }
+        }
+    }
+    if (!error.empty()) {
+        WARNING("Ignoring index file for segment %s and reading all of its "
+                "entries instead: %s",
+                segment.filename.c_str(),
+                error.c_str());
+        return false;
+    }
+
+    for (int i = 0; i < index.offset_size(); ++i) {
+        segment.entries.emplace_back(index.offset(i));
+        Segment::Record& record = segment.entries.back();
+        record.term = index.term(i);
+        record.type = Protocol::Raft::EntryType(index.type(i));
+    }
+    segment.bytes = index.bytes();
     return true;
 }
 
@@ -1002,11 +1310,13 @@ SegmentedLog::loadOpenSegment(Segment& segment, uint64_t logStartIndex)
     uint64_t lastIndex = 0;
     while (offset < reader.getFileLength()) {
         segment.entries.emplace_back(offset);
+        std::shared_ptr<Entry> entry = std::make_shared<Entry>();
         std::string error = readProtoFromFile(
                 file,
                 reader,
                 &offset,
-                &segment.entries.back().entry);
+                entry.get());
+        segment.entries.back().setEntry(std::move(entry));
         if (!error.empty()) {
             segment.entries.pop_back();
             uint64_t remainingBytes = reader.getFileLength() - offset;
@@ -1037,17 +1347,17 @@ SegmentedLog::loadOpenSegment(Segment& segment, uint64_t logStartIndex)
             FS::fsync(file);
             break;
         }
-        lastIndex = segment.entries.back().entry.index();
+        lastIndex = segment.entries.back().entry->index();
     }
 
     bool remove = false;
     if (segment.entries.empty()) {
         NOTICE("Removing empty segment: %s", segment.filename.c_str());
         remove = true;
-    } else if (segment.entries.back().entry.index() < logStartIndex) {
+    } else if (segment.entries.back().entry->index() < logStartIndex) {
         NOTICE("Removing open segment whose entries are no longer "
                "needed (last index is %lu but log start index is %lu): %s",
-               segment.entries.back().entry.index(),
+               segment.entries.back().entry->index(),
                logStartIndex,
                segment.filename.c_str());
         remove = true;
@@ -1058,10 +1368,9 @@ SegmentedLog::loadOpenSegment(Segment& segment, uint64_t logStartIndex)
         return false;
     } else {
         segment.bytes = offset;
-        totalClosedSegmentBytes += segment.bytes;
         segment.isOpen = false;
-        segment.startIndex = segment.entries.front().entry.index();
-        segment.endIndex = segment.entries.back().entry.index();
+        segment.startIndex = segment.entries.front().entry->index();
+        segment.endIndex = segment.entries.back().entry->index();
         std::string newFilename = segment.makeClosedFilename();
         NOTICE("Closing open segment %s, renaming to %s",
                 segment.filename.c_str(),
@@ -1070,6 +1379,7 @@ SegmentedLog::loadOpenSegment(Segment& segment, uint64_t logStartIndex)
                    dir, newFilename);
         FS::fsync(dir);
         segment.filename = newFilename;
+        writeSegmentIndex(segment);
         return true;
     }
 }
@@ -1090,6 +1400,8 @@ SegmentedLog::checkInvariants()
     assert(logStartIndex <= segmentsByStartIndex.begin()->second.endIndex + 1);
     assert(currentSync.get() != NULL);
     uint64_t closedBytes = 0;
+    uint64_t cachedEntries = 0;
+    uint64_t cachedBytes = 0;
     for (auto it = segmentsByStartIndex.begin();
          it != segmentsByStartIndex.end();
          ++it) {
@@ -1100,10 +1412,25 @@ SegmentedLog::checkInvariants()
         assert(segment.startIndex > 0);
         assert(segment.entries.size() ==
                segment.endIndex + 1 - segment.startIndex);
+        bool readable = (!segment.isOpen &&
+                         segment.readableAfterSync <= syncsCompleted);
         uint64_t lastOffset = 0;
         for (uint64_t i = 0; i < segment.entries.size(); ++i) {
-            assert(segment.entries.at(i).entry.index() ==
-                   segment.startIndex + i);
+            const Segment::Record& record = segment.entries.at(i);
+            if (record.entry) {
+                assert(record.entry->index() == segment.startIndex + i);
+                assert(record.entry->term() == record.term);
+                assert(record.entry->type() == record.type);
+            } else
+                assert(readable);
+            if (record.cached) {
+                assert(readable && record.entry);
+                assert(*record.lruPosition == segment.startIndex + i);
+                ++cachedEntries;
+                cachedBytes += getRecordBytes(segment, i);
+            } else if (readable) {
+                assert(!record.entry);
+            }
             if (i == 0)
                 assert(segment.entries.at(0).offset == sizeof(SegmentHeader));
             else
@@ -1125,6 +1452,8 @@ SegmentedLog::checkInvariants()
         }
     }
     assert(closedBytes == totalClosedSegmentBytes);
+    assert(cachedEntries == entryCacheLru.size());
+    assert(cachedBytes == entryCacheBytes);
 #endif /* DEBUG */
 }
 
@@ -1162,9 +1491,178 @@ SegmentedLog::closeSegment()
                dir, newFilename);
     FS::fsync(dir);
     openSegment.filename = newFilename;
+    writeSegmentIndex(openSegment);
 
     openSegment.isOpen = false;
+    openSegment.readableAfterSync = 0;
     totalClosedSegmentBytes += openSegment.bytes;
+    cacheEntries(openSegment);
+    evictEntries();
+}
+
+Core::Buffer
+SegmentedLog::makeSegmentIndex(const Segment& segment) const
+{
+    assert(!segment.isOpen);
+    SegmentedLogMetadata::SegmentIndex index;
+    index.set_start_index(segment.startIndex);
+    index.set_end_index(segment.endIndex);
+    index.set_bytes(segment.bytes);
+    for (auto it = segment.entries.begin();
+         it != segment.entries.end();
+         ++it) {
+        index.add_offset(it->offset);
+        index.add_term(it->term);
+        index.add_type(uint32_t(it->type));
+    }
+    return serializeProto(index);
+}
+
+void
+SegmentedLog::writeSegmentIndex(const Segment& segment) const
+{
+    Core::Buffer record = makeSegmentIndex(segment);
+    FS::File file = FS::openFile(dir, segment.makeIndexFilename(),
+                                 O_CREAT|O_WRONLY|O_TRUNC);
+    ssize_t written = FS::write(file.fd,
+                                record.getData(),
+                                record.getLength());
+    if (written == -1) {
+        PANIC("Failed to write to %s: %s",
+              file.path.c_str(), strerror(errno));
+    }
+}
+
+const SegmentedLog::Segment&
+SegmentedLog::getSegment(uint64_t index) const
+{
+    if (index < getLogStartIndex() ||
+        index > getLastLogIndex()) {
+        PANIC("Attempted to access entry %lu outside of log "
+              "(start index is %lu, last index is %lu)",
+              index, getLogStartIndex(), getLastLogIndex());
+    }
+    auto it = segmentsByStartIndex.upper_bound(index);
+    --it;
+    const Segment& segment = it->second;
+    assert(segment.startIndex <= index);
+    assert(index <= segment.endIndex);
+    return segment;
+}
+
+uint64_t
+SegmentedLog::getRecordBytes(const Segment& segment, uint64_t i) const
+{
+    uint64_t end = (i + 1 < segment.entries.size()
+                        ? segment.entries.at(i + 1).offset
+                        : segment.bytes);
+    return end - segment.entries.at(i).offset;
+}
+
+void
+SegmentedLog::cacheEntries(Segment& segment)
+{
+    assert(!segment.isOpen);
+    for (uint64_t i = 0; i < segment.entries.size(); ++i) {
+        Segment::Record& record = segment.entries.at(i);
+        if (!record.entry || record.cached)
+            continue;
+        record.cached = true;
+        entryCacheLru.push_front(segment.startIndex + i);
+        record.lruPosition = entryCacheLru.begin();
+        entryCacheBytes += getRecordBytes(segment, i);
+    }
+}
+
+void
+SegmentedLog::uncacheEntries(Segment& segment, uint64_t i)
+{
+    for (; i < segment.entries.size(); ++i) {
+        Segment::Record& record = segment.entries.at(i);
+        if (!record.cached)
+            continue;
+        entryCacheLru.erase(record.lruPosition);
+        entryCacheBytes -= getRecordBytes(segment, i);
+        record.cached = false;
+    }
+}
+
+void
+SegmentedLog::evictEntries() const
+{
+    while (entryCacheBytes > entryCacheBudget && entryCacheLru.size() > 1) {
+        uint64_t index = entryCacheLru.back();
+        auto it = segmentsByStartIndex.upper_bound(index);
+        --it;
+        const Segment& segment = it->second;
+        uint64_t i = index - segment.startIndex;
+        const Segment::Record& record = segment.entries.at(i);
+        assert(record.cached);
+        entryCacheBytes -= getRecordBytes(segment, i);
+        entryCacheLru.pop_back();
+        record.cached = false;
+        record.entry.reset();
+        ++numEntryCacheEvictions;
+    }
+}
+
+void
+SegmentedLog::cacheClosingSegments()
+{
+    while (!closingSegments.empty()) {
+        auto it = segmentsByStartIndex.find(closingSegments.front());
+        if (it != segmentsByStartIndex.end() && !it->second.isOpen) {
+            Segment& segment = it->second;
+            if (segment.readableAfterSync > syncsCompleted)
+                break;
+            cacheEntries(segment);
+        }
+        closingSegments.pop_front();
+    }
+    evictEntries();
+}
+
+Log::EntryPtr
+SegmentedLog::readEntry(const Segment& segment, uint64_t i) const
+{
+    assert(!segment.isOpen);
+    assert(segment.readableAfterSync <= syncsCompleted);
+    if (!segmentReader || segmentReaderStartIndex != segment.startIndex) {
+        closeSegmentReader();
+        segmentReaderFile = FS::openFile(dir, segment.filename, O_RDONLY);
+        segmentReader.reset(new FS::FileContents(segmentReaderFile));
+        segmentReaderStartIndex = segment.startIndex;
+    }
+    uint64_t offset = segment.entries.at(i).offset;
+    std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+    std::string error = readProtoFromFile(segmentReaderFile,
+                                          *segmentReader,
+                                          &offset,
+                                          entry.get());
+    if (!error.empty()) {
+        PANIC("Could not read entry %lu back in from log segment %s "
+              "(offset %lu bytes). Error was: %s",
+              segment.startIndex + i,
+              segment.filename.c_str(),
+              segment.entries.at(i).offset,
+              error.c_str());
+    }
+    if (entry->index() != segment.startIndex + i) {
+        PANIC("Read entry %lu back in from log segment %s, but expected "
+              "entry %lu",
+              entry->index(),
+              segment.filename.c_str(),
+              segment.startIndex + i);
+    }
+    return entry;
+}
+
+void
+SegmentedLog::closeSegmentReader() const
+{
+    segmentReader.reset();
+    segmentReaderFile.close();
+    segmentReaderStartIndex = 0;
 }
 
 SegmentedLog::Segment&
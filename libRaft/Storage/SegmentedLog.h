@@ -15,6 +15,7 @@
  */
 
 #include <deque>
+#include <list>
 #include <thread>
 #include <vector>
 
@@ -67,6 +68,14 @@ namespace Storage {
  * inopportune time (the segment file is first renamed, then truncated, and a
  * crash occurs in between).
  *
+ * Each closed segment has an index file next to it, named after the segment
+ * with ".index" appended (see SegmentedLogMetadata::SegmentIndex). It lists
+ * the offset, term, and type of every entry in the segment, so that the
+ * segment can be opened on boot without parsing its records; the entries are
+ * then read in on demand. Index files are a cache: a missing, corrupt, or
+ * stale index file just causes the segment to be read in full (and the index
+ * to be rewritten), and index files without a matching segment are removed.
+ *
  * Open segments are named by the format string "open-%lu" with a unique
  * number. These should not exist when the server shuts down cleanly, but they
  * exist while the server is running and may be left around during a crash.
@@ -125,8 +134,11 @@ class SegmentedLog : public Log {
 
     // Methods implemented from Log interface
     std::pair<uint64_t, uint64_t>
-    append(const std::vector<const Entry*>& entries);
+    append(const std::vector<EntryPtr>& entries);
     const Entry& getEntry(uint64_t) const;
+    EntryPtr getEntryPtr(uint64_t) const;
+    uint64_t getEntryTerm(uint64_t) const;
+    Protocol::Raft::EntryType getEntryType(uint64_t) const;
     uint64_t getLogStartIndex() const;
     uint64_t getLastLogIndex() const;
     std::string getName() const;
@@ -271,6 +283,9 @@ class SegmentedLog : public Log {
                 FSYNC,
                 CLOSE,
                 UNLINKAT,
+                /// Create (or replace) the file named filename1 in the
+                /// directory fd and write writeData to it.
+                WRITE_FILE,
                 NOOP,
             };
             Op(int fd, OpCode opCode)
@@ -328,6 +343,11 @@ class SegmentedLog : public Log {
              */
             explicit Record(uint64_t offset);
 
+            /**
+             * Set #entry, along with #term and #type from it.
+             */
+            void setEntry(Log::EntryPtr newEntry);
+
             /**
              * Byte offset in the file where the entry begins.
              * This is used when truncating a segment.
@@ -335,9 +355,36 @@ class SegmentedLog : public Log {
             uint64_t offset;
 
             /**
-             * The entry itself.
+             * The entry itself, shared with whoever else is using it (see
+             * Log::EntryPtr). For closed segments, this may be NULL if the
+             * entry has been evicted from the entry cache; it is then read
+             * back from the segment file on demand. This is mutable since
+             * getEntryPtr() fills it in.
+             */
+            mutable Log::EntryPtr entry;
+
+            /**
+             * The entry's term, kept even if the entry is evicted.
+             */
+            uint64_t term;
+
+            /**
+             * The entry's type, kept even if the entry is evicted.
+             */
+            Protocol::Raft::EntryType type;
+
+            /**
+             * True if this entry is resident and counted in the entry cache
+             * (SegmentedLog::entryCacheLru), false otherwise. Entries in the
+             * open segment and in segments that may not be readable yet are
+             * never in the cache.
              */
-            Log::Entry entry;
+            mutable bool cached;
+
+            /**
+             * If #cached, this entry's position in SegmentedLog::entryCacheLru.
+             */
+            mutable std::list<uint64_t>::iterator lruPosition;
         };
 
         /**
@@ -351,6 +398,12 @@ class SegmentedLog : public Log {
          */
         std::string makeClosedFilename() const;
 
+        /**
+         * Return the name of the index file for a closed segment named
+         * #filename. See SegmentedLogMetadata::SegmentIndex.
+         */
+        std::string makeIndexFilename() const;
+
         /**
          * True for the open segment, false for closed segments.
          */
@@ -378,6 +431,14 @@ class SegmentedLog : public Log {
          * The entries in this segment, from startIndex to endIndex, inclusive.
          */
         std::deque<Record> entries;
+        /**
+         * For segments closed by append(), the renaming and the writes of the
+         * segment's entries are deferred to a Sync object. This is the number
+         * of that Sync (see SegmentedLog::syncsTaken); the segment's file may
+         * only be read back once that many Syncs have completed. Zero for
+         * segments that are readable right away.
+         */
+        uint64_t readableAfterSync;
 
     };
 
@@ -404,6 +465,21 @@ class SegmentedLog : public Log {
      */
     std::vector<Segment> readSegmentFilenames();
 
+    /**
+     * Try to fill in a closed segment's entries from its index file, without
+     * reading its records. The entries themselves are left to be read back in
+     * on demand. This is only used during initialization.
+     * \param[in,out] segment
+     *      Closed segment with no entries yet.
+     * \param fileLength
+     *      The length of the segment file, which must cover the segment's
+     *      entries according to the index.
+     * \return
+     *      True if the index was found and valid; false if the caller should
+     *      read the segment's records instead.
+     */
+    bool loadSegmentIndex(Segment& segment, uint64_t fileLength) const;
+
     /**
      * Read a metadata file from disk. This is only used during initialization.
      * \param filename
@@ -420,9 +496,31 @@ class SegmentedLog : public Log {
                              SegmentedLogMetadata::Metadata& metadata,
                              bool quiet) const;
 
+    /**
+     * Load the segments found by #readSegmentFilenames() into
+     * #segmentsByStartIndex. Closed segments are read and verified in
+     * parallel, then added in order; open segments are recovered afterwards,
+     * one at a time. This is only used during initialization.
+     * \param segments
+     *      Segments returned by #readSegmentFilenames(). These are moved from.
+     * \param numThreads
+     *      The number of threads to load closed segments with. Controlled by
+     *      the 'storageLoadThreads' config option.
+     */
+    void loadSegments(std::vector<Segment>& segments, uint64_t numThreads);
+
+    /**
+     * Add a segment that has been loaded from disk to #segmentsByStartIndex
+     * and the entry cache. PANICs if another segment has the same start
+     * index. This is only used during initialization.
+     */
+    void addLoadedSegment(Segment segment);
+
     /**
      * Read the given closed segment from disk, issuing PANICs and WARNINGs
-     * appropriately. This is only used during initialization.
+     * appropriately. This is only used during initialization. It may be
+     * called from several threads at once (for different segments), so it
+     * must not modify any shared state.
      *
      * Deletes segment if its last index is below logStartIndex.
      *
@@ -481,6 +579,85 @@ class SegmentedLog : public Log {
      */
     void closeSegment();
 
+    /**
+     * Build the index file contents for a closed segment.
+     * \return
+     *      A record with the SegmentIndex, as produced by #serializeProto().
+     */
+    Core::Buffer makeSegmentIndex(const Segment& segment) const;
+
+    /**
+     * Write out the index file for a closed segment, replacing any previous
+     * one. The file isn't flushed, since a damaged index just causes the
+     * segment to be read in fully on the next startup.
+     */
+    void writeSegmentIndex(const Segment& segment) const;
+
+    /**
+     * Find the segment containing the given entry, or PANIC if the entry is
+     * outside of the log.
+     */
+    const Segment& getSegment(uint64_t index) const;
+
+    /**
+     * Return the number of bytes the given entry takes up in its segment file.
+     * This is how entries are weighed against #entryCacheBudget.
+     * \param segment
+     *      A closed segment.
+     * \param i
+     *      Offset of the entry within the segment's entries.
+     */
+    uint64_t getRecordBytes(const Segment& segment, uint64_t i) const;
+
+    /**
+     * Place any resident entries of a segment into the entry cache, as the
+     * most recently used. The segment must be closed and its file readable.
+     * The caller should call #evictEntries() afterwards.
+     */
+    void cacheEntries(Segment& segment);
+
+    /**
+     * Remove entries from the entry cache before they are discarded from the
+     * segment, without dropping the entries themselves.
+     * \param segment
+     *      The segment containing the entries.
+     * \param i
+     *      Offset of the first entry to remove within the segment's entries.
+     *      Every entry from here to the end of the segment is removed.
+     */
+    void uncacheEntries(Segment& segment, uint64_t i);
+
+    /**
+     * Drop the least recently used entries in the entry cache until it fits
+     * in #entryCacheBudget. The most recently used entry is always kept, so
+     * that the reference getEntry() returns stays valid until the next call
+     * into the log.
+     */
+    void evictEntries() const;
+
+    /**
+     * Called after a Sync completes to add segments closed by append() to the
+     * entry cache once their files are in place.
+     */
+    void cacheClosingSegments();
+
+    /**
+     * Read an evicted entry back in from its closed segment file.
+     * \param segment
+     *      A closed segment that is readable (see Segment::readableAfterSync).
+     * \param i
+     *      Offset of the entry within the segment's entries.
+     * \return
+     *      The entry read from disk. PANICs if it can't be read.
+     */
+    Log::EntryPtr readEntry(const Segment& segment, uint64_t i) const;
+
+    /**
+     * Release the file that #readEntry() reads from, if any. This must be
+     * called before the file is truncated, renamed, or removed.
+     */
+    void closeSegmentReader() const;
+
     /**
      * Return a reference to the current open segment (the one that new writes
      * should go into). Crashes if there is no open segment (but it's an
@@ -622,6 +799,82 @@ class SegmentedLog : public Log {
      */
     uint64_t totalClosedSegmentBytes;
 
+    /**
+     * The maximum number of bytes of entries from closed segments to keep in
+     * memory. Controlled by the 'storageEntryCacheBytes' config option.
+     */
+    const uint64_t entryCacheBudget;
+
+    /**
+     * The indexes of the resident entries of closed segments, from most
+     * recently used (front) to least recently used (back). Like the rest of
+     * the log, this is protected by the caller's lock; it's mutable since it's
+     * updated from getEntryPtr().
+     */
+    mutable std::list<uint64_t> entryCacheLru;
+
+    /**
+     * The sum of getRecordBytes() for the entries in #entryCacheLru.
+     */
+    mutable uint64_t entryCacheBytes;
+
+    /**
+     * The number of getEntryPtr() calls on closed segments that found the
+     * entry in memory.
+     */
+    mutable uint64_t numEntryCacheHits;
+
+    /**
+     * The number of getEntryPtr() calls that had to read the entry from its
+     * segment file.
+     */
+    mutable uint64_t numEntryCacheMisses;
+
+    /**
+     * The number of entries dropped from memory by #evictEntries().
+     */
+    mutable uint64_t numEntryCacheEvictions;
+
+    /**
+     * The file #segmentReader maps, or closed if there is none.
+     */
+    mutable FilesystemUtil::File segmentReaderFile;
+
+    /**
+     * The contents of the closed segment #readEntry() read from last, kept
+     * around since consecutive misses tend to hit the same segment.
+     */
+    mutable std::unique_ptr<FilesystemUtil::FileContents> segmentReader;
+
+    /**
+     * The start index of the segment #segmentReader belongs to.
+     */
+    mutable uint64_t segmentReaderStartIndex;
+
+    /**
+     * The number of Sync objects returned by takeSync() so far.
+     */
+    uint64_t syncsTaken;
+
+    /**
+     * The number of Sync objects passed back to syncCompleteVirtual() so far.
+     * Syncs complete in the order they were taken.
+     */
+    uint64_t syncsCompleted;
+
+    /**
+     * The start indexes of segments closed by append() that aren't in the
+     * entry cache yet, in the order they were closed. See
+     * Segment::readableAfterSync.
+     */
+    std::deque<uint64_t> closingSegments;
+
+    /**
+     * How long it took to load the log's segments from disk when this object
+     * was constructed, in nanoseconds.
+     */
+    uint64_t startupLoadNanos;
+
     /**
      * See PreparedSegments.
      */
@@ -161,6 +161,12 @@ enum class Status {
      * before the timeout elapsed.
      */
     TIMEOUT = 4,
+
+    /**
+     * A predicate set with Store::setCondition() was not true when the
+     * operation was applied, so the operation had no effect.
+     */
+    CONDITION_NOT_MET = 5,
 };
 
 /**
@@ -191,6 +197,28 @@ struct Result {
     std::string error;
 };
 
+/**
+ * One operation of an atomic Store::batch().
+ */
+struct BatchOperation {
+    /**
+     * Set the value of 'path' to 'contents'.
+     */
+    static BatchOperation write(const std::string& path,
+                                const std::string& contents);
+    /**
+     * Remove 'path'.
+     */
+    static BatchOperation remove(const std::string& path);
+
+    /**
+     * True to remove 'path', false to write 'contents' to it.
+     */
+    bool isRemove;
+    std::string path;
+    std::string contents;
+};
+
 /**
  * Provides access to the hierarchical key-value store.
  * You can get an instance of Tree through Cluster::getTree() or by copying
@@ -236,6 +264,28 @@ class Store {
      */
     void setTimeout(uint64_t nanoseconds);
 
+    /**
+     * Set a predicate on all future read-write operations (write(), remove()
+     * and batch()). If the predicate is not true when an operation is applied
+     * on the servers, the operation has no effect and fails with status
+     * CONDITION_NOT_MET. This allows compare-and-swap style updates in a
+     * single round trip.
+     * \param path
+     *      The path of the file that must have the given contents. If this is
+     *      empty, no condition is set.
+     * \param value
+     *      The contents that the file must have. If this is the empty string,
+     *      the file must not exist.
+     */
+    void setCondition(const std::string& path, const std::string& value);
+
+    /**
+     * Return the predicate set by setCondition().
+     * \return
+     *      The path and contents of the condition; see setCondition().
+     */
+    std::pair<std::string, std::string> getCondition() const;
+
     /**
      * Set the value of a file.
      * \param path
@@ -275,6 +325,28 @@ class Store {
     Result
     read(const std::string& path, std::string& contents) const;
 
+    /**
+     * Get the values of many files at once. This costs a single round trip
+     * to the cluster leader and reads all files from the same state of the
+     * store, which is much cheaper than calling read() for each one.
+     * \param paths
+     *      The paths of the files whose contents to read.
+     * \param[out] results
+     *      The outcome of reading each file, parallel to 'paths', with the
+     *      same possible errors as read().
+     * \param[out] contents
+     *      The contents of each file, parallel to 'paths'; empty for files
+     *      that could not be read.
+     * \return
+     *      Status and error message for the request as a whole. Possible
+     *      errors are:
+     *       - TIMEOUT if timeout elapsed before the operation completed.
+     */
+    Result
+    multiRead(const std::vector<std::string>& paths,
+              std::vector<Result>& results,
+              std::vector<std::string>& contents) const;
+
     /**
      * Make sure a file does not exist.
      * \param path
@@ -290,6 +362,22 @@ class Store {
     Result
     remove(const std::string& path);
 
+    /**
+     * Apply many writes and removes atomically, as a single operation in the
+     * replicated log. Either every operation takes effect, in order, or none
+     * does.
+     * \param ops
+     *      The operations to apply. The whole batch is sent in a single RPC,
+     *      so it must fit within Protocol::Common::MAX_MESSAGE_LENGTH.
+     * \return
+     *      Status and error message. Possible errors are:
+     *       - INVALID_ARGUMENT if any path or written contents are empty.
+     *       - CONDITION_NOT_MET if any path is reserved.
+     *       - TIMEOUT if timeout elapsed before the operation completed.
+     */
+    Result
+    batch(const std::vector<BatchOperation>& ops);
+
     Result
     stat(const std::string& client, std::string& contents) const;
 
@@ -297,6 +385,41 @@ class Store {
     range(const std::string& start_key, const std::string& end_key,
           uint64_t limit, std::vector<std::string>& contents);
 
+    /**
+     * List a range of keys, optionally with their values, one page at a time.
+     * \param start_key
+     *      The smallest key to return, or empty for no lower bound.
+     * \param end_key
+     *      The largest key to return, or empty for no upper bound.
+     * \param limit
+     *      If nonzero, the maximum number of keys to return in this page.
+     * \param reverse
+     *      If true, list the keys in descending order.
+     * \param includeValues
+     *      If true, fill in 'values' as well.
+     * \param cursor
+     *      Empty for the first page; otherwise, the nextCursor returned for
+     *      the previous page of the same range and direction.
+     * \param[out] keys
+     *      The keys in this page.
+     * \param[out] values
+     *      The value of each key in 'keys', if includeValues is set.
+     * \param[out] nextCursor
+     *      An opaque cursor for fetching the next page, or empty if this page
+     *      reached the end of the range.
+     * \return
+     *      Status and error message. Possible errors are:
+     *       - INVALID_ARGUMENT if the cursor is malformed.
+     *       - TIMEOUT if timeout elapsed before the operation completed.
+     */
+    Result
+    range(const std::string& start_key, const std::string& end_key,
+          uint64_t limit, bool reverse, bool includeValues,
+          const std::string& cursor,
+          std::vector<std::string>& keys,
+          std::vector<std::string>& values,
+          std::string& nextCursor);
+
     Result
     search(const std::string& search_key,
            uint64_t limit, std::vector<std::string>& contents);
@@ -347,6 +470,12 @@ class Cluster {
      *      the client will wait until giving up on the close session RPC. It
      *      defaults to tcpConnectTimeoutMilliseconds, since they should be on
      *      the same order of magnitude.
+     * - spreadReads:
+     *      If "true", read-only Store operations are sent to random servers
+     *      in the cluster rather than to the leader. This only spreads load
+     *      when the servers are configured with followerReads (see
+     *      sample.conf); otherwise followers redirect each read and it costs
+     *      an extra round trip. Defaults to false.
      */
     typedef std::map<std::string, std::string> Options;
 